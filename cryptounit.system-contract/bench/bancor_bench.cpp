@@ -0,0 +1,236 @@
+// exchange_state::convert: the fixed_point conversions of bancor.hpp against the double ones they replaced.
+//   bancor_bench --check   every buyram and sellram conversion within tolerance of the double result,
+//                          exit code 1 otherwise
+//   bancor_bench           check, then ns per buyram conversion, core -> RAMCORE -> RAM
+// Markets are set up as init does: 10^14 RAMCORE, 64 GiB of RAM, 1% of the core supply. Each buy is
+// followed by the sell of the bytes it got; both versions start every conversion from the same market,
+// which then moves on with the fixed_point result. The RAM balances eosio.system_tests expects are
+// replayed with both versions.
+// Natively std::pow is a few hardware instructions; on nodeos every double operation goes through softfloat,
+// which these timings do not show.
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#include <eosio.system/bancor.hpp>
+
+using conversion = int64_t (*)( int64_t& supply, int64_t& balance, double weight, int64_t in );
+
+// exchange_state::convert_to_exchange and convert_from_exchange
+static int64_t fixed_to_exchange( int64_t& supply, int64_t& balance, double weight, int64_t in )
+{
+   return eosiosystem::bancor_to_exchange( supply, balance, eosiosystem::bancor_weight_of( weight ), in );
+}
+
+static int64_t fixed_from_exchange( int64_t& supply, int64_t& balance, double weight, int64_t in )
+{
+   return eosiosystem::bancor_from_exchange( supply, balance, eosiosystem::bancor_weight_of( weight ), in );
+}
+
+// convert_to_exchange before fixed_point
+static int64_t double_to_exchange( int64_t& supply, int64_t& balance, double weight, int64_t in )
+{
+   double R(supply);
+   double C(balance + in);
+   double F(weight);
+   double T(in);
+   double ONE(1.0);
+
+   double E = -R * (ONE - std::pow( ONE + T / C, F) );
+   int64_t issued = int64_t(E);
+
+   supply += issued;
+   balance += in;
+   return issued;
+}
+
+// convert_from_exchange before fixed_point
+static int64_t double_from_exchange( int64_t& supply, int64_t& balance, double weight, int64_t in )
+{
+   double R(supply - in);
+   double C(balance);
+   double F(1.0/weight);
+   double E(in);
+   double ONE(1.0);
+
+   double T = C * (std::pow( ONE + E/R, F) - ONE);
+   int64_t out = int64_t(T);
+
+   supply -= in;
+   balance -= out;
+   return out;
+}
+
+struct market {
+   int64_t supply;  // RAMCORE
+   int64_t base;    // RAM bytes
+   int64_t quote;   // core token
+   double weight;   // of both connectors
+};
+
+// as convert chains the two halves through RAMCORE
+static int64_t buy_bytes( market& m, int64_t core, conversion to_exchange, conversion from_exchange )
+{
+   const int64_t ramcore = to_exchange( m.supply, m.quote, m.weight, core );
+   return from_exchange( m.supply, m.base, m.weight, ramcore );
+}
+
+static int64_t sell_bytes( market& m, int64_t bytes, conversion to_exchange, conversion from_exchange )
+{
+   const int64_t ramcore = to_exchange( m.supply, m.base, m.weight, bytes );
+   return from_exchange( m.supply, m.quote, m.weight, ramcore );
+}
+
+static const int64_t ram_bytes = 64ll * 1024 * 1024 * 1024;
+
+struct check_stats {
+   uint64_t conversions = 0;
+   uint64_t differing = 0;
+   int64_t max_difference = 0;
+};
+
+// Each half truncates towards zero; a unit more or less RAMCORE moves the second half by less than a unit
+// on these markets, so a conversion is off by at most two units plus the double rounding error.
+static bool close_enough( int64_t expected, int64_t actual, check_stats& stats )
+{
+   const int64_t difference = std::llabs( expected - actual );
+   ++stats.conversions;
+   if( difference != 0 ) {
+      ++stats.differing;
+   }
+   if( difference > stats.max_difference ) {
+      stats.max_difference = difference;
+   }
+   return difference <= 2 + int64_t( std::fabs( double(expected) ) * 1e-12 );
+}
+
+// buyram and sellram with their 0.5% fees, rounded up, in core token units
+static int64_t buyram( market& m, int64_t quant, conversion to_exchange, conversion from_exchange )
+{
+   return buy_bytes( m, quant - ( quant + 199 ) / 200, to_exchange, from_exchange );
+}
+
+static int64_t sellram( market& m, int64_t bytes, conversion to_exchange, conversion from_exchange )
+{
+   const int64_t tokens_out = sell_bytes( m, bytes, to_exchange, from_exchange );
+   return tokens_out - ( tokens_out + 199 ) / 200;
+}
+
+// The balances buysell and stake_unstake of eosio.system_tests expect, replayed on the market of the
+// tester chain: default max_ram_size of 32 GiB, 1% of the 1000000000.0000 issued, connector weights 1.
+static bool replay_system_tests( conversion to_exchange, conversion from_exchange )
+{
+   market m{ 100000000000000ll, 32ll * 1024 * 1024 * 1024, 1000000000'0000ll / 100, 1.0 };
+   // remaining_setup: alice1111111, bob111111111, carol1111111
+   for( int64_t quant : { 1'0000ll, 4500ll, 1'0000ll } ) {
+      buyram( m, quant, to_exchange, from_exchange );
+   }
+
+   market u = m;
+   // stake_unstake: cross_15_percent_threshold, then aliceaccount and bobbyaccount
+   for( int64_t quant : { 1'0000ll, 1'0000ll, 1'0000ll } ) {
+      buyram( u, quant, to_exchange, from_exchange );
+   }
+   const int64_t stake_unstake = 700'0000 + sellram( u, buyram( u, 300'0000, to_exchange, from_exchange ), to_exchange, from_exchange );
+
+   int64_t alice = 800'0000;
+   alice += sellram( m, buyram( m, 200'0000, to_exchange, from_exchange ), to_exchange, from_exchange );
+   const int64_t after_small = alice;
+   alice += 100000000'0000ll - 10000000'0000ll;
+   alice += sellram( m, buyram( m, 10000000'0000ll, to_exchange, from_exchange ), to_exchange, from_exchange );
+   const int64_t after_large = alice;
+   int64_t bytes = 0;
+   for( int64_t quant : { 100'0000ll, 100'0000ll, 100'0000ll, 100'0000ll, 100'0000ll, 10'0000ll, 10'0000ll, 10'0000ll, 30'0000ll } ) {
+      alice -= quant;
+      bytes += buyram( m, quant, to_exchange, from_exchange );
+   }
+   alice += sellram( m, bytes, to_exchange, from_exchange );
+   const int64_t after_many = alice;
+   bytes = 0;
+   for( int64_t quant : { 10000000'0000ll, 10000000'0000ll, 10000000'0000ll, 10000000'0000ll, 10000000'0000ll,
+                          100000'0000ll, 100000'0000ll, 100000'0000ll, 300000'0000ll } ) {
+      alice -= quant;
+      bytes += buyram( m, quant, to_exchange, from_exchange );
+   }
+   alice += sellram( m, bytes, to_exchange, from_exchange );
+
+   const int64_t expected[] = { 998'0047, 99901248'0046ll, 99901242'4174ll, 99396507'4122ll, 997'0073 };
+   const int64_t replayed[] = { after_small, after_large, after_many, alice, stake_unstake };
+   for( size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i ) {
+      if( replayed[i] != expected[i] ) {
+         std::printf( "system test balance %zu: %lld, the test expects %lld\n", i, (long long)replayed[i], (long long)expected[i] );
+         return false;
+      }
+   }
+   return true;
+}
+
+static bool check()
+{
+   check_stats stats;
+   for( double weight : { 1.0, 0.5 } ) {
+      for( int64_t core_supply : { 10000000000ll, 10000000000000ll, 1000000000000000ll } ) {
+         market m{ 100000000000000ll, ram_bytes, core_supply / 100, weight };
+         for( int64_t core = 1; core < m.quote; core += core / 4 + 7 ) {
+            market d = m;
+            const int64_t expected_bytes = buy_bytes( d, core, double_to_exchange, double_from_exchange );
+            const int64_t bytes = buy_bytes( m, core, fixed_to_exchange, fixed_from_exchange );
+            if( ! close_enough( expected_bytes, bytes, stats ) ) {
+               std::printf( "buyram mismatch: weight %g, core supply %lld, %lld core: %lld bytes, double %lld\n",
+                            weight, (long long)core_supply, (long long)core, (long long)bytes, (long long)expected_bytes );
+               return false;
+            }
+
+            d = m;
+            const int64_t expected_core = sell_bytes( d, bytes, double_to_exchange, double_from_exchange );
+            const int64_t core_out = sell_bytes( m, bytes, fixed_to_exchange, fixed_from_exchange );
+            if( ! close_enough( expected_core, core_out, stats ) ) {
+               std::printf( "sellram mismatch: weight %g, core supply %lld, %lld bytes: %lld core, double %lld\n",
+                            weight, (long long)core_supply, (long long)bytes, (long long)core_out, (long long)expected_core );
+               return false;
+            }
+         }
+      }
+   }
+   if( ! replay_system_tests( double_to_exchange, double_from_exchange ) || ! replay_system_tests( fixed_to_exchange, fixed_from_exchange ) ) {
+      return false;
+   }
+   std::printf( "%llu of %llu conversions differ from the double results, by at most %lld units; "
+                "the buysell and stake_unstake balances are the same with both\n",
+                (unsigned long long)stats.differing, (unsigned long long)stats.conversions, (long long)stats.max_difference );
+   return true;
+}
+
+static double ns_per_buy( conversion to_exchange, conversion from_exchange, uint32_t iterations )
+{
+   const market start{ 100000000000000ll, ram_bytes, 100000000000ll, 1.0 };
+   volatile int64_t sink = 0;
+   const auto begin = std::chrono::steady_clock::now();
+   for( uint32_t i = 0; i < iterations; ++i ) {
+      market m = start;
+      sink = sink + buy_bytes( m, int64_t( 10000 + i ), to_exchange, from_exchange );
+   }
+   const auto elapsed = std::chrono::steady_clock::now() - begin;
+   return std::chrono::duration<double, std::nano>( elapsed ).count() / iterations;
+}
+
+int main( int argc, char** argv )
+{
+   if( ! check() ) {
+      return 1;
+   }
+   if( argc > 1 && std::strcmp( argv[1], "--check" ) == 0 ) {
+      return 0;
+   }
+
+   const uint32_t iterations = 1000000;
+   std::printf( "buyram convert, double:      %8.2f ns\n", ns_per_buy( double_to_exchange, double_from_exchange, iterations ) );
+   std::printf( "buyram convert, fixed_point: %8.2f ns\n", ns_per_buy( fixed_to_exchange, fixed_from_exchange, iterations ) );
+   return 0;
+}
@@ -0,0 +1,104 @@
+// stake2vote: fixed_point::exp2 per call against the compile-time week_weight_table.
+//   stake2vote_bench --check   both give the same vote weight, exit code 1 on mismatch
+//   stake2vote_bench           check, then ns per stake2vote and per voteproducer vote weight update
+// A voteproducer with a 30 producer ballot computes the voter's weight once and applies the old and
+// the new weight to every producer on the ballot; the table reads and writes around it are not modelled.
+// Natively __int128 is two machine multiplications, in WASM it is a library call, so the gap on chain
+// is wider than here.
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+
+#include <eosio.system/vote_weight.hpp>
+
+using eosiosystem::fixed_point;
+
+// stake2vote before week_weight_table
+static double exp2_stake2vote( int64_t staked, int64_t weeks )
+{
+   const fixed_point fraction = fixed_point::from_ratio( weeks % 52, 52 );
+   return double( fixed_point::exp2( fraction ).mul_int( staked ) ) * double( uint64_t(1) << (weeks / 52) );
+}
+
+static double table_stake2vote( int64_t staked, int64_t weeks )
+{
+   return eosiosystem::vote_weight( staked, weeks );
+}
+
+static bool check()
+{
+   for( int64_t weeks = 0; weeks < 52 * 40; ++weeks ) {
+      for( int64_t staked : { 0ll, 1ll, 10000ll, 123456789ll, 10000000000000ll, 1000000000000000000ll } ) {
+         if( exp2_stake2vote( staked, weeks ) != table_stake2vote( staked, weeks ) ) {
+            std::printf( "mismatch: staked %lld, week %lld\n", (long long)staked, (long long)weeks );
+            return false;
+         }
+      }
+   }
+   std::printf( "week_weight_table gives the same vote weights as fixed_point::exp2\n" );
+   return true;
+}
+
+static const uint32_t ballot_size = 30;
+
+// weight of the voter, then the change of every producer on the ballot, as in update_votes
+template<typename F>
+static double voteproducer( F stake2vote, int64_t staked, int64_t weeks, double last_vote_weight, double* total_votes )
+{
+   const double new_vote_weight = stake2vote( staked, weeks );
+   for( uint32_t p = 0; p < ballot_size; ++p ) {
+      total_votes[p] += new_vote_weight - last_vote_weight;
+      if( total_votes[p] < 0 ) {
+         total_votes[p] = 0;
+      }
+   }
+   return new_vote_weight;
+}
+
+template<typename F>
+static double ns_per_call( F f, uint32_t iterations )
+{
+   volatile double sink = 0;
+   const auto start = std::chrono::steady_clock::now();
+   for( uint32_t i = 0; i < iterations; ++i ) {
+      sink = sink + f( int64_t( 10000 + i ), int64_t( 260 + i % 52 ) );
+   }
+   const auto elapsed = std::chrono::steady_clock::now() - start;
+   return std::chrono::duration<double, std::nano>( elapsed ).count() / iterations;
+}
+
+template<typename F>
+static double ns_per_voteproducer( F f, uint32_t iterations )
+{
+   double total_votes[ballot_size] = {};
+   double last_vote_weight = 0;
+   const auto start = std::chrono::steady_clock::now();
+   for( uint32_t i = 0; i < iterations; ++i ) {
+      last_vote_weight = voteproducer( f, int64_t( 10000 + i ), int64_t( 260 + i % 52 ), last_vote_weight, total_votes );
+   }
+   const auto elapsed = std::chrono::steady_clock::now() - start;
+   volatile double sink = total_votes[0];
+   (void)sink;
+   return std::chrono::duration<double, std::nano>( elapsed ).count() / iterations;
+}
+
+int main( int argc, char** argv )
+{
+   if( ! check() ) {
+      return 1;
+   }
+   if( argc > 1 && std::strcmp( argv[1], "--check" ) == 0 ) {
+      return 0;
+   }
+
+   const uint32_t iterations = 2000000;
+   std::printf( "stake2vote, exp2:          %8.2f ns\n", ns_per_call( exp2_stake2vote, iterations ) );
+   std::printf( "stake2vote, table:         %8.2f ns\n", ns_per_call( table_stake2vote, iterations ) );
+   std::printf( "voteproducer %u, exp2:     %8.2f ns\n", ballot_size, ns_per_voteproducer( exp2_stake2vote, iterations ) );
+   std::printf( "voteproducer %u, table:    %8.2f ns\n", ballot_size, ns_per_voteproducer( table_stake2vote, iterations ) );
+   return 0;
+}
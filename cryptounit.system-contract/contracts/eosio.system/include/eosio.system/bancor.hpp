@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <eosio.system/fixed_point.hpp>
+
+namespace eosiosystem {
+
+   /**
+    *  The two halves of exchange_state::convert on plain amounts. Like fixed_point.hpp the header does
+    *  not depend on eosiolib, so the conversions the contract runs are checked natively against the
+    *  double versions they replaced. Both update supply and the connector balance and return the amount
+    *  out, truncated towards zero.
+    */
+
+   /// connector weight F and 1/F in Q64.64
+   struct bancor_weight {
+      fixed_point weight;
+      fixed_point reciprocal;
+   };
+
+   static constexpr bancor_weight bancor_weight_one{ fixed_point::one(), fixed_point::one() };
+   static constexpr bancor_weight bancor_weight_half{ fixed_point::from_ratio( 1, 2 ), fixed_point::from_int( 2 ) };
+
+   /**
+    *  The weight of a connector as stored in its double field. The weights markets are created with
+    *  are matched on their bit pattern, an integer compare, and need no floating point at all.
+    */
+   inline bancor_weight bancor_weight_of( double weight ) {
+      uint64_t bits;
+      std::memcpy( &bits, &weight, sizeof(bits) );
+      if( bits == 0x3FF0000000000000ull ) { // 1.0
+         return bancor_weight_one;
+      }
+      if( bits == 0x3FE0000000000000ull ) { // 0.5
+         return bancor_weight_half;
+      }
+      return { fixed_point::from_double( weight ), fixed_point::from_double( 1.0/weight ) };
+   }
+
+   /// E = R * ((1 + T/C)^F - 1): smart tokens issued for in tokens paid into the connector
+   inline int64_t bancor_to_exchange( int64_t& supply, int64_t& balance, const bancor_weight& w, int64_t in ) {
+      const int64_t R = supply;
+      const int64_t C = balance + in;
+      const fixed_point x = fixed_point::from_ratio( in, C );
+
+      const int64_t issued = fixed_point::expm1( w.weight * fixed_point::log1p( x ) ).mul_int( R );
+
+      supply += issued;
+      balance += in;
+      return issued;
+   }
+
+   /// T = C * ((1 + E/R)^(1/F) - 1): connector tokens paid out for in smart tokens
+   inline int64_t bancor_from_exchange( int64_t& supply, int64_t& balance, const bancor_weight& w, int64_t in ) {
+      const int64_t R = supply - in;
+      const int64_t C = balance;
+      const fixed_point x = fixed_point::from_ratio( in, R );
+
+      const int64_t out = fixed_point::expm1( w.reciprocal * fixed_point::log1p( x ) ).mul_int( C );
+
+      supply -= in;
+      balance -= out;
+      return out;
+   }
+
+} /// namespace eosiosystem
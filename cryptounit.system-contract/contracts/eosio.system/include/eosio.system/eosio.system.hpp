@@ -20,6 +20,19 @@
 // be set to 0.
 #define CHANNEL_RAM_AND_NAMEBID_FEES_TO_REX 1
 
+// STAKER_DEBUG_PRINT macro determines whether the staker actions print intermediate values
+// to the console. Build with -DSTAKER_DEBUG_PRINT=1 to enable.
+#ifndef STAKER_DEBUG_PRINT
+#define STAKER_DEBUG_PRINT 0
+#endif
+
+// STAKER_REFRESH_RESULTS macro determines whether every staker settlement sends a refreshresult
+// action to the staker.results contract on eosio.stake, so that indexers can read the credited
+// reward from the action trace. Build with -DSTAKER_REFRESH_RESULTS=1 to enable.
+#ifndef STAKER_REFRESH_RESULTS
+#define STAKER_REFRESH_RESULTS 0
+#endif
+
 namespace eosiosystem {
 
    using eosio::name;
@@ -93,7 +106,7 @@ namespace eosiosystem {
       time_point           last_pervote_bucket_fill;
       int64_t              pervote_bucket = 0;
       int64_t              perblock_bucket = 0;
-      uint32_t             total_unpaid_blocks = 0; /// all blocks which have been produced but not paid
+      uint32_t             total_unpaid_blocks = 0; /// produced, not paid and flushed to producer rows; the rest is counted in unpaidblks
       int64_t              total_activated_stake = 0;
       time_point           thresh_activated_stake_time;
       uint16_t             last_producer_schedule_size = 0;
@@ -150,6 +163,43 @@ namespace eosiosystem {
 
       EOSLIB_SERIALIZE( eosio_global_state4, (total_stakers_balance)(total_stakers_cru_balance)(total_stakers_frozen_cru_balance)(total_stakers_wcru_balance)(total_stakers_frozen_wcru_balance)(stakers_bucket)(current_emission_rate)(next_emission_step_start_at)(next_emission_rate)(emission_step_in_usec)(total_cliffs_in_period))
    };
+
+   /**
+    * Defines new global state parameters added after the staker release.
+    *
+    * Inflation is accrued here per bucket and only minted when a bucket is drawn from
+    * or when emission_flush_interval has elapsed since the last mint.
+    */
+   struct [[eosio::table("global5"), eosio::contract("eosio.system")]] eosio_global_state5 {
+      eosio_global_state5() { }
+      int64_t           pending_savings = 0;           /// accrued for eosio.saving, not yet issued
+      int64_t           pending_perblock = 0;          /// accrued for eosio.bpay, not yet issued
+      int64_t           pending_pervote = 0;           /// accrued for eosio.vpay, not yet issued
+      int64_t           pending_owner = 0;             /// accrued for the owner account, not yet issued
+      uint32_t          emission_flush_interval = 0;   /// seconds between mints, 0 mints on every block
+      time_point        last_emission_flush;
+      uint128_t         stakers_reward_index = 0;      /// cumulative stakers emission per staked unit, see refresh
+      time_point        stakers_index_started_at;
+      time_point        stakers_index_updated_at;
+      bool              stakers_migrated = false;      /// all legacy staker rows are moved to stakerv2
+      int64_t           core_supply = 0;               /// core token supply as of supply_synced_at plus what was issued since
+      int64_t           core_max_supply = 0;           /// core token max_supply as of supply_synced_at
+      time_point        supply_synced_at;              /// last read of the eosio.token stat row, see syncsupply
+      capi_checksum256  last_schedule_hash = {};       /// sha256 of the last packed schedule passed to set_proposed_producers
+      uint64_t          schedule_recomputes = 0;       /// update_elected_producers runs that built a schedule
+      uint64_t          schedule_skips = 0;            /// of those, runs that found it equal to last_schedule_hash
+      int64_t           stakers_shortfall = 0;         /// staker rewards the stakers bucket could not cover, not paid
+
+      int64_t pending_emission()const {
+         return pending_savings + pending_perblock + pending_pervote + pending_owner;
+      }
+
+      EOSLIB_SERIALIZE( eosio_global_state5, (pending_savings)(pending_perblock)(pending_pervote)(pending_owner)
+                        (emission_flush_interval)(last_emission_flush)
+                        (stakers_reward_index)(stakers_index_started_at)(stakers_index_updated_at)
+                        (stakers_migrated)(core_supply)(core_max_supply)(supply_synced_at)
+                        (last_schedule_hash)(schedule_recomputes)(schedule_skips)(stakers_shortfall) )
+   };
  
   struct [[eosio::table, eosio::contract("eosio.system")]] stakers {
     eosio::name username;
@@ -199,6 +249,37 @@ namespace eosiosystem {
   };
 
   typedef eosio::multi_index<"stakers3"_n, stakers3> stakers3_index;
+
+
+  /**
+   * All staker state in one row, replaces stakers, stakers2 and stakers3.
+   * Amounts are raw, in _cru_symbol, _wcru_symbol and _emit_symbol units.
+   * Legacy rows are moved over on first access or by migratestkr.
+   * Pending reward is staked_balance * (stakers_reward_index - reward_index).
+   */
+  struct [[eosio::table, eosio::contract("eosio.system")]] staker_v2 {
+    eosio::name username;
+    uint8_t version = 1;
+    eosio::time_point last_update_at;
+    int64_t staked_cru = 0;
+    int64_t staked_wcru = 0;
+    int64_t staked_frozen_wcru = 0;
+    int64_t emitted = 0;
+    uint128_t reward_index = 0;          /// eosio_global_state5::stakers_reward_index at the last refresh
+    int64_t cru_on_withdraw = 0;
+    int64_t wcru_on_withdraw = 0;
+    eosio::time_point withdraw_updated_at;
+
+    uint64_t primary_key() const {return username.value;}
+    uint64_t byupdate() const {return uint64_t(last_update_at.time_since_epoch().count());}
+    uint64_t staked_balance() const {return uint64_t(staked_cru + staked_wcru);}
+
+    EOSLIB_SERIALIZE(staker_v2, (username)(version)(last_update_at)(staked_cru)(staked_wcru)(staked_frozen_wcru)(emitted)(reward_index)(cru_on_withdraw)(wcru_on_withdraw)(withdraw_updated_at))
+  };
+
+  typedef eosio::multi_index<"stakerv2"_n, staker_v2,
+    eosio::indexed_by<"byupdate"_n, eosio::const_mem_fun<staker_v2, uint64_t, &staker_v2::byupdate>>
+  > stakers_v2_index;
     
 
 
@@ -278,10 +359,104 @@ namespace eosiosystem {
                              > producers_table;
    typedef eosio::multi_index< "producers2"_n, producer_info2 > producers_table2;
 
+   struct unpaid_block_count {
+      name        producer;
+      uint32_t    unpaid_blocks = 0;
+
+      EOSLIB_SERIALIZE( unpaid_block_count, (producer)(unpaid_blocks) )
+   };
+
+   /**
+    *  Blocks produced since the last flush, one entry per producer of the proposed schedule plus
+    *  producers of the outgoing schedule that are still producing. onblock counts here instead of
+    *  in producer_info::unpaid_blocks and in the global total_unpaid_blocks; the counts are moved to
+    *  both when a new schedule is proposed, and the claiming producer's count is taken on claimrewards.
+    */
+   struct [[eosio::table("unpaidblks"), eosio::contract("eosio.system")]] unpaid_blocks_state {
+      unpaid_blocks_state() { }
+      std::vector<unpaid_block_count> producers;
+
+      EOSLIB_SERIALIZE( unpaid_blocks_state, (producers) )
+   };
+
+   static constexpr uint32_t top_producers_size = 30;   /// ranked producers kept in top_producers_state
+
+   struct producer_rank {
+      name                  owner;
+      double                total_votes = 0;
+      eosio::public_key     producer_key;   /// copied from producer_info for the schedule
+      uint16_t              location = 0;
+
+      EOSLIB_SERIALIZE( producer_rank, (owner)(total_votes)(producer_key)(location) )
+   };
+
+   /**
+    *  The top_producers_size active producers with the most votes, kept by the vote paths so that
+    *  update_elected_producers neither walks the prototalvote index nor reads the producer rows.
+    *  No active producer outside producers has more than cutoff votes; a member falling below
+    *  cutoff leaves the ranking, which is rebuilt from the index once fewer than 21 are left.
+    */
+   struct [[eosio::table("topprods"), eosio::contract("eosio.system")]] top_producers_state {
+      top_producers_state() { }
+      bool                          built = false;   /// false until the first rebuild from the index
+      std::vector<producer_rank>    producers;       /// by total_votes descending, then owner
+      double                        cutoff = 0;
+
+      EOSLIB_SERIALIZE( top_producers_state, (built)(producers)(cutoff) )
+   };
+
    typedef eosio::singleton< "global"_n, eosio_global_state >   global_state_singleton;
    typedef eosio::singleton< "global2"_n, eosio_global_state2 > global_state2_singleton;
    typedef eosio::singleton< "global3"_n, eosio_global_state3 > global_state3_singleton;
    typedef eosio::singleton< "global4"_n, eosio_global_state4> global_state4_singleton;
+   typedef eosio::singleton< "global5"_n, eosio_global_state5 > global_state5_singleton;
+   typedef eosio::singleton< "unpaidblks"_n, unpaid_blocks_state > unpaid_blocks_singleton;
+   typedef eosio::singleton< "topprods"_n, top_producers_state > top_producers_singleton;
+
+   /**
+    *  Global state singleton that is deserialized only on first access and written back
+    *  only if its serialized form differs from the row that was loaded.
+    */
+   template<typename T, typename Singleton>
+   class tracked_global {
+      public:
+         using default_factory = T(*)();
+
+         tracked_global( name code, uint64_t scope, default_factory make_default = nullptr )
+         :_singleton( code, scope ), _make_default( make_default ) {}
+
+         T& operator*()  { return get(); }
+         T* operator->() { return &get(); }
+
+         T& get() {
+            if( !_state ) {
+               if( _singleton.exists() ) {
+                  _state = _singleton.get();
+                  _loaded = eosio::pack( *_state );
+               } else {
+                  _state = _make_default ? _make_default() : T{};
+               }
+            }
+            return *_state;
+         }
+
+         /// Writes the row if it was accessed and changed, or accessed and did not exist yet
+         void flush( name payer ) {
+            if( !_state )
+               return;
+            auto packed = eosio::pack( *_state );
+            if( packed == _loaded )
+               return;
+            _singleton.set( *_state, payer );
+            _loaded = std::move( packed );
+         }
+
+      private:
+         Singleton           _singleton;
+         default_factory     _make_default;
+         std::optional<T>    _state;
+         std::vector<char>   _loaded;
+   };
 
    static constexpr uint32_t     seconds_per_day = 24 * 3600;
 
@@ -377,14 +552,13 @@ namespace eosiosystem {
          voters_table            _voters;
          producers_table         _producers;
          producers_table2        _producers2;
-         global_state_singleton  _global;
-         global_state2_singleton _global2;
-         global_state3_singleton _global3;
-         global_state4_singleton _global4;
-         eosio_global_state      _gstate;
-         eosio_global_state2     _gstate2;
-         eosio_global_state3     _gstate3;
-         eosio_global_state4     _gstate4;
+         tracked_global<eosio_global_state,  global_state_singleton>  _gstate;
+         tracked_global<eosio_global_state2, global_state2_singleton> _gstate2;
+         tracked_global<eosio_global_state3, global_state3_singleton> _gstate3;
+         tracked_global<eosio_global_state4, global_state4_singleton> _gstate4;
+         tracked_global<eosio_global_state5, global_state5_singleton> _gstate5;
+         tracked_global<unpaid_blocks_state, unpaid_blocks_singleton> _unpaid_blocks;
+         tracked_global<top_producers_state, top_producers_singleton> _top_producers;
          rammarket               _rammarket;
          rex_pool_table          _rexpool;
          rex_fund_table          _rexfunds;
@@ -642,6 +816,21 @@ namespace eosiosystem {
          [[eosio::action]]
          void claimrewards( const name owner );
 
+         /**
+          * Sets how often accrued inflation is minted and moved to its buckets.
+          * Zero restores minting on every block.
+          */
+         [[eosio::action]]
+         void setemitflush( uint32_t flush_interval_sec );
+
+         /**
+          *  Reloads the core token supply and max_supply kept in global5 from the eosio.token stat row.
+          *  emit_to_buckets only reads the copy and reloads it once a day, so this applies a retire or
+          *  an issue other than the system contract's own before then.
+          */
+         [[eosio::action]]
+         void syncsupply();
+
          [[eosio::action]]
          void setpriv( name account, uint8_t is_priv );
 
@@ -680,6 +869,15 @@ namespace eosiosystem {
 
          [[eosio::action]]
          void frwithdraw(const eosio::name username);
+
+         [[eosio::action]]
+         void migratestkr(uint32_t max_rows);
+
+         [[eosio::action]]
+         void refreshmany(const std::vector<eosio::name>& usernames);
+
+         [[eosio::action]]
+         void refreshcrank(uint16_t max_rows);
          
 
          using getreward_action = eosio::action_wrapper<"getreward"_n, &system_contract::getreward>;
@@ -687,6 +885,9 @@ namespace eosiosystem {
          using stake_action = eosio::action_wrapper<"stake"_n, &system_contract::stake>;
          using frozenustake_action = eosio::action_wrapper<"frunstake"_n, &system_contract::frunstake>;
          using frozenstake_action = eosio::action_wrapper<"frstake"_n, &system_contract::frstake>;
+         using migratestkr_action = eosio::action_wrapper<"migratestkr"_n, &system_contract::migratestkr>;
+         using refreshmany_action = eosio::action_wrapper<"refreshmany"_n, &system_contract::refreshmany>;
+         using refreshcrank_action = eosio::action_wrapper<"refreshcrank"_n, &system_contract::refreshcrank>;
          
          using init_action = eosio::action_wrapper<"init"_n, &system_contract::init>;
          using setacctram_action = eosio::action_wrapper<"setacctram"_n, &system_contract::setacctram>;
@@ -724,6 +925,7 @@ namespace eosiosystem {
          using voteproducer_action = eosio::action_wrapper<"voteproducer"_n, &system_contract::voteproducer>;
          using regproxy_action = eosio::action_wrapper<"regproxy"_n, &system_contract::regproxy>;
          using claimrewards_action = eosio::action_wrapper<"claimrewards"_n, &system_contract::claimrewards>;
+         using setemitflush_action = eosio::action_wrapper<"setemitflush"_n, &system_contract::setemitflush>;
          using rmvproducer_action = eosio::action_wrapper<"rmvproducer"_n, &system_contract::rmvproducer>;
          using updtrevision_action = eosio::action_wrapper<"updtrevision"_n, &system_contract::updtrevision>;
          using bidname_action = eosio::action_wrapper<"bidname"_n, &system_contract::bidname>;
@@ -794,6 +996,8 @@ namespace eosiosystem {
          void update_elected_producers( block_timestamp timestamp );
          void update_votes( const name voter, const name proxy, const std::vector<name>& producers, bool voting );
          void propagate_weight_change( const voter_info& voter );
+         void rank_producer( const producer_info& prod );
+         void rebuild_top_producers();
          double update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
                                                time_point ct,
                                                double shares_rate, bool reset_to_zero = false );
@@ -804,13 +1008,23 @@ namespace eosiosystem {
 
 
          void emit_to_buckets();
+         void flush_emission();
+         void count_unpaid_block( name producer );
+         void flush_unpaid_blocks( const std::vector<name>& next_producers );
+         uint32_t take_unpaid_blocks( name producer );
+         uint32_t counted_unpaid_blocks();
+         void sync_supply();
          int64_t get_current_emission_step(time_point last_update);
          int64_t get_emission_rate(int64_t current_step);
          int64_t get_next_emission_rate(int64_t current_step);
          time_point get_next_step_date(int64_t current_step);
+         uint128_t cumulative_emission(time_point at);
 
-         time_point get_right_time_border(time_point last_update, time_point ct);
-         time_point get_left_time_border(time_point last_update);
+         uint128_t stakers_emission_between(time_point from, time_point to);
+         void update_stakers_index();
+         void settle_staker(staker_v2& s, time_point ct);
+         stakers_v2_index::const_iterator find_staker(stakers_v2_index& stakers, const name username);
+         stakers_v2_index::const_iterator migrate_staker(stakers_v2_index& stakers, const name username);
 
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <eosiolib/asset.hpp>
+#include <eosio.system/bancor.hpp>
 
 namespace eosiosystem {
    using eosio::asset;
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+
+namespace eosiosystem {
+
+   /**
+    *  Signed Q64.64 fixed point number stored in a __int128.
+    *
+    *  Used instead of double in the hot paths of the system contract: WASM floating point goes
+    *  through softfloat on nodeos, integer arithmetic does not. The header does not depend on
+    *  eosiolib so the same code can be checked natively against <cmath>.
+    *
+    *  Multiplications are exact to 2^-64 as long as the integer part of the result fits into
+    *  63 bits; callers are expected to keep values in range.
+    */
+   class fixed_point {
+      public:
+         static constexpr int       frac_bits = 64;
+         static constexpr __int128  one_raw   = __int128(1) << frac_bits;
+
+         constexpr fixed_point() = default;
+
+         static constexpr fixed_point from_raw( __int128 raw ) { fixed_point r; r._raw = raw; return r; }
+         static constexpr fixed_point from_int( int64_t v )    { return from_raw( __int128(v) << frac_bits ); }
+         static constexpr fixed_point one()                    { return from_raw( one_raw ); }
+
+         /// num / den, |num| < 2^63, den != 0
+         static constexpr fixed_point from_ratio( int64_t num, int64_t den ) {
+            return from_raw( (__int128(num) << frac_bits) / den );
+         }
+
+         /// Only for values read from existing double fields
+         static fixed_point from_double( double v ) {
+            const bool neg = v < 0;
+            if( neg ) v = -v;
+            const uint64_t int_part = uint64_t(v);
+            const uint64_t frac_part = uint64_t( (v - double(int_part)) * 18446744073709551616.0 );
+            const __int128 raw = (__int128(int_part) << frac_bits) | frac_part;
+            return from_raw( neg ? -raw : raw );
+         }
+
+         constexpr __int128 raw()const { return _raw; }
+
+         /// Rounds toward zero
+         constexpr int64_t to_int()const {
+            return _raw >= 0 ? int64_t( _raw >> frac_bits ) : -int64_t( (-_raw) >> frac_bits );
+         }
+
+         double to_double()const {
+            const unsigned __int128 a = _raw >= 0 ? _raw : -_raw;
+            const double r = double( uint64_t(a >> frac_bits) ) + double( uint64_t(a) ) / 18446744073709551616.0;
+            return _raw >= 0 ? r : -r;
+         }
+
+         constexpr fixed_point operator+( fixed_point o )const { return from_raw( _raw + o._raw ); }
+         constexpr fixed_point operator-( fixed_point o )const { return from_raw( _raw - o._raw ); }
+         constexpr fixed_point operator-()const                { return from_raw( -_raw ); }
+         constexpr fixed_point operator*( fixed_point o )const { return from_raw( mul_raw( _raw, o._raw ) ); }
+         constexpr fixed_point operator>>( int n )const        { return from_raw( _raw >> n ); }
+         constexpr fixed_point operator<<( int n )const        { return from_raw( _raw << n ); }
+
+         constexpr bool operator<( fixed_point o )const  { return _raw <  o._raw; }
+         constexpr bool operator<=( fixed_point o )const { return _raw <= o._raw; }
+         constexpr bool operator==( fixed_point o )const { return _raw == o._raw; }
+
+         /// v * this, rounded toward zero; the result must fit into int64_t
+         constexpr int64_t mul_int( int64_t v )const {
+            const bool neg = (v < 0) != (_raw < 0);
+            const unsigned __int128 a = _raw >= 0 ? _raw : -_raw;
+            const uint64_t m = v >= 0 ? uint64_t(v) : uint64_t(0) - uint64_t(v);
+            const unsigned __int128 r = (a >> frac_bits) * m + ( (a & uint64_t(-1)) * m >> frac_bits );
+            return neg ? -int64_t(r) : int64_t(r);
+         }
+
+         /// ln(2) rounded to 64 fractional bits
+         static constexpr fixed_point ln2() { return from_raw( __int128(0xB17217F7D1CF79ACull) ); }
+
+         /// e^x, x < 43
+         static constexpr fixed_point exp( fixed_point x ) {
+            // x = k*ln2 + r, 0 <= r < ln2
+            const fixed_point l2 = ln2();
+            int64_t k = int64_t( x._raw / l2._raw );
+            fixed_point r = x - from_raw( l2._raw * k );
+            if( r._raw < 0 ) { r = r + l2; --k; }
+
+            // Taylor series, r^n/n! drops below 2^-64 after 20 terms for r < ln2
+            fixed_point sum  = one();
+            fixed_point term = one();
+            for( int n = 1; n < 24 && term._raw != 0; ++n ) {
+               term = from_raw( mul_raw( term._raw, r._raw ) / n );
+               sum  = sum + term;
+            }
+            return k >= 0 ? sum << int(k) : sum >> int(-k);
+         }
+
+         /// 2^x
+         static constexpr fixed_point exp2( fixed_point x ) {
+            const int64_t n = x._raw >> frac_bits; // floor
+            const fixed_point f = from_raw( x._raw - (__int128(n) << frac_bits) );
+            const fixed_point m = exp( f * ln2() );
+            return n >= 0 ? m << int(n) : m >> int(-n);
+         }
+
+         /// ln(x), x > 0
+         static constexpr fixed_point log( fixed_point x ) {
+            // x = 2^k * m, 1 <= m < 2
+            int k = 0;
+            __int128 m = x._raw;
+            while( m >= 2 * one_raw ) { m >>= 1; ++k; }
+            while( m < one_raw )      { m <<= 1; --k; }
+
+            // ln(m) = 2 * atanh(s), s = (m - 1) / (m + 1) <= 1/3
+            const fixed_point s  = from_raw( ( (m - one_raw) << (frac_bits - 2) ) / ( (m + one_raw) >> 2 ) );
+            const fixed_point s2 = s * s;
+            fixed_point power = s;
+            fixed_point sum;
+            for( int n = 1; n < 64 && power._raw != 0; n += 2 ) {
+               sum   = sum + from_raw( power._raw / n );
+               power = power * s2;
+            }
+            return from_raw( sum._raw * 2 + ln2()._raw * k );
+         }
+
+         /// ln(1 + x), x > -1
+         static constexpr fixed_point log1p( fixed_point x ) { return log( one() + x ); }
+
+         /// e^x - 1
+         static constexpr fixed_point expm1( fixed_point x ) { return exp( x ) - one(); }
+
+         /// base^e, base > 0
+         static constexpr fixed_point pow( fixed_point base, fixed_point e ) { return exp( e * log( base ) ); }
+
+      private:
+         __int128 _raw = 0;
+
+         static constexpr __int128 mul_raw( __int128 a, __int128 b ) {
+            const bool neg = (a < 0) != (b < 0);
+            const unsigned __int128 ua = a >= 0 ? a : -a;
+            const unsigned __int128 ub = b >= 0 ? b : -b;
+            const unsigned __int128 ah = ua >> frac_bits, al = uint64_t(ua);
+            const unsigned __int128 bh = ub >> frac_bits, bl = uint64_t(ub);
+            const unsigned __int128 r = ( (ah * bh) << frac_bits ) + ah * bl + al * bh + ( (al * bl) >> frac_bits );
+            return neg ? -__int128(r) : __int128(r);
+         }
+   };
+
+} /// namespace eosiosystem
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <eosiolib/eosio.hpp>
+#include <eosiolib/name.hpp>
+
+using eosio::name;
+using eosio::action_wrapper;
+
+class [[eosio::contract("staker.results")]] staker_results : eosio::contract {
+   public:
+
+      using eosio::contract::contract;
+
+      /**
+       * Reward credited to username by a staker settlement, in _emit_symbol units, the
+       * stakers_reward_index it was settled at and the stakers bucket left afterwards.
+       */
+      [[eosio::action]]
+      void refreshresult( const name& username, int64_t emitted, const uint128_t& reward_index, int64_t stakers_bucket );
+
+      using refreshresult_action = action_wrapper<"refreshresult"_n, &staker_results::refreshresult>;
+};
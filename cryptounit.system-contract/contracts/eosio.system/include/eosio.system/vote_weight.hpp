@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include <eosio.system/fixed_point.hpp>
+
+namespace eosiosystem {
+
+   static constexpr int64_t weeks_per_year = 52;
+
+   /**
+    *  2^(k/52) for every week k of a year. Evaluated at compile time, so stake2vote does one
+    *  multiplication instead of a fixed_point::exp2 series; the values are the same.
+    */
+   struct week_weights {
+      fixed_point weight[weeks_per_year];
+   };
+
+   constexpr week_weights make_week_weights() {
+      week_weights t{};
+      for( int64_t k = 0; k < weeks_per_year; ++k ) {
+         t.weight[k] = fixed_point::exp2( fixed_point::from_ratio( k, weeks_per_year ) );
+      }
+      return t;
+   }
+
+   constexpr week_weights week_weight_table = make_week_weights();
+
+   static_assert( week_weight_table.weight[0] == fixed_point::one(), "2^0" );
+
+   /// staked * 2^(weeks/52), staked >= 0, weeks >= 0
+   inline double vote_weight( int64_t staked, int64_t weeks ) {
+      // staked * 2^(weeks/52) = (staked * 2^(fraction)) << whole years
+      const fixed_point& weight = week_weight_table.weight[weeks % weeks_per_year];
+      int64_t years = weeks / weeks_per_year;
+
+      // weight < 2, so mul_int stays in int64_t up to 2^62, the asset amount limit;
+      // a larger stake is multiplied in two halves
+      const double fraction_weight = staked <= (int64_t(1) << 62)
+         ? double( weight.mul_int( staked ) )
+         : double( weight.mul_int( staked / 2 ) ) + double( weight.mul_int( staked - staked / 2 ) );
+
+      // the shift is only defined up to 63 years, whole multiples of 2^63 are scaled in double
+      double scale = 1;
+      for( ; years >= 63; years -= 63 ) {
+         scale *= 9223372036854775808.0;
+      }
+      return fraction_weight * scale * double( uint64_t(1) << years );
+   }
+
+} /// namespace eosiosystem
@@ -16,10 +16,13 @@ namespace eosiosystem {
     _voters(_self, _self.value),
     _producers(_self, _self.value),
     _producers2(_self, _self.value),
-    _global(_self, _self.value),
-    _global2(_self, _self.value),
-    _global3(_self, _self.value),
-    _global4(_self, _self.value),
+    _gstate(_self, _self.value, &system_contract::get_default_parameters),
+    _gstate2(_self, _self.value),
+    _gstate3(_self, _self.value),
+    _gstate4(_self, _self.value),
+    _gstate5(_self, _self.value),
+    _unpaid_blocks(_self, _self.value),
+    _top_producers(_self, _self.value),
     _rammarket(_self, _self.value),
     _rexpool(_self, _self.value),
     _rexfunds(_self, _self.value),
@@ -27,10 +30,7 @@ namespace eosiosystem {
     _rexorders(_self, _self.value)
    {
       //print( "construct system\n" );
-      _gstate  = _global.exists() ? _global.get() : get_default_parameters();
-      _gstate2 = _global2.exists() ? _global2.get() : eosio_global_state2{};
-      _gstate3 = _global3.exists() ? _global3.get() : eosio_global_state3{};
-      _gstate4 = _global4.exists() ? _global4.get() : eosio_global_state4{};
+      // global state rows are loaded on first access, see tracked_global
    }
 
    eosio_global_state system_contract::get_default_parameters() {
@@ -60,20 +60,23 @@ namespace eosiosystem {
    }
 
    system_contract::~system_contract() {
-      _global.set( _gstate, _self );
-      _global2.set( _gstate2, _self );
-      _global3.set( _gstate3, _self );
-      _global4.set( _gstate4, _self );
+      _gstate.flush( _self );
+      _gstate2.flush( _self );
+      _gstate3.flush( _self );
+      _gstate4.flush( _self );
+      _gstate5.flush( _self );
+      _unpaid_blocks.flush( _self );
+      _top_producers.flush( _self );
    }
 
    void system_contract::setram( uint64_t max_ram_size, double devider ) {
       require_auth( _self );
 
-      check( _gstate.max_ram_size <= max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
+      check( _gstate->max_ram_size <= max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
       check( max_ram_size < 1024ll*1024*1024*1024*1024, "ram size is unrealistic" );
-      check( max_ram_size > _gstate.total_ram_bytes_reserved, "attempt to set max below reserved" );
+      check( max_ram_size > _gstate->total_ram_bytes_reserved, "attempt to set max below reserved" );
 
-      auto delta = int64_t(max_ram_size) - int64_t(_gstate.max_ram_size);
+      auto delta = int64_t(max_ram_size) - int64_t(_gstate->max_ram_size);
       auto itr = _rammarket.find(ramcore_symbol.raw());
 
       /**
@@ -88,17 +91,17 @@ namespace eosiosystem {
 
       });
 
-      _gstate.max_ram_size = max_ram_size;
+      _gstate->max_ram_size = max_ram_size;
    }
 
    void system_contract::update_ram_supply() {
       auto cbt = current_block_time();
 
-      if( cbt <= _gstate2.last_ram_increase ) return;
+      if( cbt <= _gstate2->last_ram_increase ) return;
 
       auto itr = _rammarket.find(ramcore_symbol.raw());
-      auto new_ram = (cbt.slot - _gstate2.last_ram_increase.slot)*_gstate2.new_ram_per_block;
-      _gstate.max_ram_size += new_ram;
+      auto new_ram = (cbt.slot - _gstate2->last_ram_increase.slot)*_gstate2->new_ram_per_block;
+      _gstate->max_ram_size += new_ram;
 
       /**
        *  Increase the amount of ram for sale based upon the change in max ram size.
@@ -106,7 +109,7 @@ namespace eosiosystem {
       _rammarket.modify( itr, same_payer, [&]( auto& m ) {
          m.base.balance.amount += new_ram;
       });
-      _gstate2.last_ram_increase = cbt;
+      _gstate2->last_ram_increase = cbt;
    }
 
    /**
@@ -120,13 +123,13 @@ namespace eosiosystem {
       require_auth( _self );
 
       update_ram_supply();
-      _gstate2.new_ram_per_block = bytes_per_block;
+      _gstate2->new_ram_per_block = bytes_per_block;
    }
 
    void system_contract::setparams( const eosio::blockchain_parameters& params ) {
       require_auth( _self );
-      (eosio::blockchain_parameters&)(_gstate) = params;
-      check( 3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3" );
+      (eosio::blockchain_parameters&)(*_gstate) = params;
+      check( 3 <= _gstate->max_authority_depth, "max_authority_depth should be at least 3" );
       set_blockchain_parameters( params );
    }
 
@@ -293,15 +296,16 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&](auto& p) {
             p.deactivate();
          });
+      rank_producer( *prod );
    }
 
    void system_contract::updtrevision( uint8_t revision ) {
       require_auth( _self );
-      check( _gstate2.revision < 255, "can not increment revision" ); // prevent wrap around
-      check( revision == _gstate2.revision + 1, "can only increment revision by one" );
+      check( _gstate2->revision < 255, "can not increment revision" ); // prevent wrap around
+      check( revision == _gstate2->revision + 1, "can only increment revision by one" );
       check( revision <= 1, // set upper bound to greatest revision supported in the code
                     "specified revision is not yet supported by the code" );
-      _gstate2.revision = revision;
+      _gstate2->revision = revision;
    }
 
    void system_contract::bidname( name bidder, name newname, asset bid ) {
@@ -455,7 +459,7 @@ namespace eosiosystem {
       _rammarket.emplace( _self, [&]( auto& m ) {
          m.supply.amount = 100000000000000ll;
          m.supply.symbol = ramcore_symbol;
-         m.base.balance.amount = int64_t(_gstate.free_ram());
+         m.base.balance.amount = int64_t(_gstate->free_ram());
          m.base.balance.symbol = ram_symbol;
          m.quote.balance.amount = system_token_supply.amount / 100;
          m.quote.balance.symbol = core;
@@ -482,7 +486,7 @@ EOSIO_DISPATCH( eosiosystem::system_contract,
      // voting.cpp
      (regproducer)(unregprod)(voteproducer)(regproxy)
      // producer_pay.cpp
-     (onblock)(claimrewards)
+     (onblock)(claimrewards)(setemitflush)(syncsupply)
      //stake.cpp
-     (activate)(frstake)(frunstake)(stake)(unstake)(refresh)(getreward)(frwithdraw)
+     (activate)(frstake)(frunstake)(stake)(unstake)(refresh)(getreward)(frwithdraw)(migratestkr)(refreshmany)(refreshcrank)
 )
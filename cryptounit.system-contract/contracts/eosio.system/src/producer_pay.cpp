@@ -35,49 +35,39 @@ namespace eosiosystem {
       name producer;
       _ds >> timestamp >> producer;
 
-      // _gstate2.last_block_num is not used anywhere in the system contract code anymore.
+      // _gstate2->last_block_num is not used anywhere in the system contract code anymore.
       // Although this field is deprecated, we will continue updating it for now until the last_block_num field
       // is eventually completely removed, at which point this line can be removed.
-      _gstate2.last_block_num = timestamp;
+      _gstate2->last_block_num = timestamp;
 
-      if( (_gstate.thresh_activated_stake_time == time_point({ microseconds{0}}))  
-         || (_gstate.thresh_activated_stake_time >= current_time_point() ))
+      if( (_gstate->thresh_activated_stake_time == time_point({ microseconds{0}}))  
+         || (_gstate->thresh_activated_stake_time >= current_time_point() ))
       {
          return;
       } 
 
-      if( _gstate.last_pervote_bucket_fill == time_point() )  /// start the presses
-         _gstate.last_pervote_bucket_fill = current_time_point();
+      if( _gstate->last_pervote_bucket_fill == time_point() )  /// start the presses
+         _gstate->last_pervote_bucket_fill = current_time_point();
 
 
       emit_to_buckets();
 
-      /**
-       * At startup the initial producer may not be one that is registered / elected
-       * and therefore there may be no producer object for them.
-       */
-      auto prod = _producers.find( producer.value );
-      if ( prod != _producers.end() ) {
-         _gstate.total_unpaid_blocks++;
-         _producers.modify( prod, same_payer, [&](auto& p ) {
-            p.unpaid_blocks++;
-         });
-      }
+      count_unpaid_block( producer );
 
       /// only update block producers once every minute, block_timestamp is in half seconds
-      if( timestamp.slot - _gstate.last_producer_schedule_update.slot > 120 ) {
+      if( timestamp.slot - _gstate->last_producer_schedule_update.slot > 120 ) {
          update_elected_producers( timestamp );
 
-         if( (timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day ) {
+         if( (timestamp.slot - _gstate->last_name_close.slot) > blocks_per_day ) {
             name_bid_table bids(_self, _self.value);
             auto idx = bids.get_index<"highbid"_n>();
             auto highest = idx.lower_bound( std::numeric_limits<uint64_t>::max()/2 );
             if( highest != idx.end() &&
                 highest->high_bid > 0 &&
                 (current_time_point() - highest->last_bid_time) > microseconds(useconds_per_day) &&
-                _gstate.thresh_activated_stake_time > time_point()
+                _gstate->thresh_activated_stake_time > time_point()
             ) {
-               _gstate.last_name_close = timestamp;
+               _gstate->last_name_close = timestamp;
                channel_namebid_to_rex( highest->high_bid );
                idx.modify( highest, same_payer, [&]( auto& b ){
                   b.high_bid = -b.high_bid;
@@ -93,10 +83,12 @@ namespace eosiosystem {
    void system_contract::emit_to_buckets(){
       time_point ct = current_time_point();
 
-      const asset token_supply   = eosio::token::get_supply(token_account, core_symbol().code() );
-      const asset max_supply = eosio::token::get_max_supply(token_account, core_symbol().code() ); 
+      // the copy only follows this contract's own mints, reload it once a day for retires and outside issues
+      if( ct - _gstate5->supply_synced_at >= microseconds(useconds_per_day) ) {
+         sync_supply();
+      }
 
-      const auto usecs_since_last_fill = (ct - _gstate.last_pervote_bucket_fill).count();
+      const auto usecs_since_last_fill = (ct - _gstate->last_pervote_bucket_fill).count();
       
       if( usecs_since_last_fill > 0 ) {
          
@@ -112,28 +104,31 @@ namespace eosiosystem {
          
          int64_t emission_rate = get_emission_rate(current_step);
 
-         if ( _gstate4.current_emission_rate.amount != emission_rate ) {
+         if ( _gstate4->current_emission_rate.amount != emission_rate ) {
 
-            _gstate4.current_emission_rate = asset(emission_rate, core_symbol());
-            _gstate4.next_emission_step_start_at = get_next_step_date(current_step);
-            _gstate4.next_emission_rate = asset(get_next_emission_rate(current_step), core_symbol());
+            _gstate4->current_emission_rate = asset(emission_rate, core_symbol());
+            _gstate4->next_emission_step_start_at = get_next_step_date(current_step);
+            _gstate4->next_emission_rate = asset(get_next_emission_rate(current_step), core_symbol());
 
-         } else if( _gstate4.next_emission_step_start_at < ct_minus_block ) {
+         } else if( _gstate4->next_emission_step_start_at < ct_minus_block ) {
 
-        	 _gstate4.next_emission_step_start_at = get_next_step_date( current_step );
+        	 _gstate4->next_emission_step_start_at = get_next_step_date( current_step );
 
          }
 
+         // accrued but not yet minted emission already counts against the max supply
+         const int64_t accrued_supply = _gstate5->core_supply + _gstate5->pending_emission();
+
          int64_t new_tokens;
 
-         if (token_supply.amount + emission_rate <= max_supply.amount){
+         if (accrued_supply + emission_rate <= _gstate5->core_max_supply){
 
             new_tokens = emission_rate;
          
          } else {
 
-            new_tokens = max_supply.amount - token_supply.amount;
-            _gstate4.current_emission_rate = asset(0, core_symbol());
+            new_tokens = _gstate5->core_max_supply - accrued_supply;
+            _gstate4->current_emission_rate = asset(0, core_symbol());
             
          }
 
@@ -158,40 +153,159 @@ namespace eosiosystem {
             to_per_block_pay = to_producers / 4;
             to_per_vote_pay  = to_producers - to_per_block_pay;
 
-            INLINE_ACTION_SENDER(eosio::token, issue)(
-               token_account, { {_self, active_permission} },
-               { _self, asset(new_tokens, core_symbol()), std::string("issue tokens for owner, producers pay and savings") }
-            );
-
-            INLINE_ACTION_SENDER(eosio::token, transfer)(
-               token_account, { {_self, active_permission} },
-               { _self, saving_account, asset(to_savings, core_symbol()), "unallocated inflation" }
-            );
-
-            INLINE_ACTION_SENDER(eosio::token, transfer)(
-               token_account, { {_self, active_permission} },
-               { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
-            );
-
-            INLINE_ACTION_SENDER(eosio::token, transfer)(
-               token_account, { {_self, active_permission} },
-               { _self, vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" }
-            );
-            
-            if( to_owner > 0 ) {
-                INLINE_ACTION_SENDER(eosio::token, transfer)(
-                   token_account, { {_self, active_permission} },
-                   { _self, owner_account, asset(to_owner, core_symbol()), "fund owner bucket" }
-                );
-            }
+            _gstate5->pending_savings  += to_savings;
+            _gstate5->pending_perblock += to_per_block_pay;
+            _gstate5->pending_pervote  += to_per_vote_pay;
+            _gstate5->pending_owner    += to_owner;
+
+            _gstate->pervote_bucket          += to_per_vote_pay;
+            _gstate->perblock_bucket         += to_per_block_pay;
+            _gstate->last_pervote_bucket_fill = ct;
+
+            _gstate4->stakers_bucket += asset(to_savings, core_symbol());
+         }
+      }
+
+      if( _gstate5->emission_flush_interval == 0 ||
+          ct - _gstate5->last_emission_flush >= microseconds(_gstate5->emission_flush_interval * int64_t(1000000)) ) {
+         flush_emission();
+      }
+   }
+
+   /**
+    *  Issues all accrued inflation in one go and moves each bucket's share to its account.
+    *  Must run before any inline transfer drawing from eosio.saving, eosio.bpay or eosio.vpay.
+    */
+   void system_contract::flush_emission() {
+      // nothing accrued: leave global5 untouched, so idle blocks do not rewrite it
+      const int64_t to_issue = _gstate5->pending_emission();
+      if( to_issue <= 0 ) {
+         return;
+      }
+
+      _gstate5->last_emission_flush = current_time_point();
+
+      INLINE_ACTION_SENDER(eosio::token, issue)(
+         token_account, { {_self, active_permission} },
+         { _self, asset(to_issue, core_symbol()), std::string("issue tokens for owner, producers pay and savings") }
+      );
+      _gstate5->core_supply += to_issue;
+
+      if( _gstate5->pending_savings > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {_self, active_permission} },
+            { _self, saving_account, asset(_gstate5->pending_savings, core_symbol()), "unallocated inflation" }
+         );
+      }
+
+      if( _gstate5->pending_perblock > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {_self, active_permission} },
+            { _self, bpay_account, asset(_gstate5->pending_perblock, core_symbol()), "fund per-block bucket" }
+         );
+      }
+
+      if( _gstate5->pending_pervote > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {_self, active_permission} },
+            { _self, vpay_account, asset(_gstate5->pending_pervote, core_symbol()), "fund per-vote bucket" }
+         );
+      }
+
+      if( _gstate5->pending_owner > 0 ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {_self, active_permission} },
+            { _self, owner_account, asset(_gstate5->pending_owner, core_symbol()), "fund owner bucket" }
+         );
+      }
 
-            _gstate.pervote_bucket          += to_per_vote_pay;
-            _gstate.perblock_bucket         += to_per_block_pay;
-            _gstate.last_pervote_bucket_fill = ct;
+      _gstate5->pending_savings  = 0;
+      _gstate5->pending_perblock = 0;
+      _gstate5->pending_pervote  = 0;
+      _gstate5->pending_owner    = 0;
+   }
 
-            _gstate4.stakers_bucket += asset(to_savings, core_symbol());
+   void system_contract::count_unpaid_block( name producer ) {
+      auto& entries = _unpaid_blocks->producers;
+      for( auto& e : entries ) {
+         if( e.producer == producer ) {
+            e.unpaid_blocks++;
+            return;
          }
       }
+
+      /**
+       * Not in the proposed schedule: a producer of the outgoing schedule, or at startup the initial
+       * producer, which may not be registered / elected and therefore have no producer object.
+       */
+      if( _producers.find( producer.value ) == _producers.end() ) {
+         return;
+      }
+      entries.push_back( unpaid_block_count{ producer, 1 } );
+   }
+
+   /**
+    *  Moves the counts of unpaid_blocks_state to producer_info and to the global total_unpaid_blocks,
+    *  and starts counting for next_producers.
+    */
+   void system_contract::flush_unpaid_blocks( const std::vector<name>& next_producers ) {
+      auto& entries = _unpaid_blocks->producers;
+      for( const auto& e : entries ) {
+         if( e.unpaid_blocks == 0 ) {
+            continue;
+         }
+         _gstate->total_unpaid_blocks += e.unpaid_blocks;
+         auto prod = _producers.find( e.producer.value );
+         if( prod != _producers.end() ) {
+            _producers.modify( prod, same_payer, [&](auto& p ) {
+               p.unpaid_blocks += e.unpaid_blocks;
+            });
+         }
+      }
+
+      entries.clear();
+      entries.reserve( next_producers.size() );
+      for( const auto& producer : next_producers ) {
+         entries.push_back( unpaid_block_count{ producer, 0 } );
+      }
+   }
+
+   /// Blocks counted in unpaid_blocks_state since the last flush, not yet in the global total_unpaid_blocks
+   uint32_t system_contract::counted_unpaid_blocks() {
+      uint32_t unpaid_blocks = 0;
+      for( const auto& e : _unpaid_blocks->producers ) {
+         unpaid_blocks += e.unpaid_blocks;
+      }
+      return unpaid_blocks;
+   }
+
+   /// Blocks counted for producer since the last flush, the count is reset
+   uint32_t system_contract::take_unpaid_blocks( name producer ) {
+      for( auto& e : _unpaid_blocks->producers ) {
+         if( e.producer == producer ) {
+            const uint32_t unpaid_blocks = e.unpaid_blocks;
+            e.unpaid_blocks = 0;
+            return unpaid_blocks;
+         }
+      }
+      return 0;
+   }
+
+   void system_contract::setemitflush( uint32_t flush_interval_sec ) {
+      require_auth( _self );
+
+      flush_emission();
+      _gstate5->emission_flush_interval = flush_interval_sec;
+   }
+
+   void system_contract::sync_supply() {
+      _gstate5->core_supply      = eosio::token::get_supply( token_account, core_symbol().code() ).amount;
+      _gstate5->core_max_supply  = eosio::token::get_max_supply( token_account, core_symbol().code() ).amount;
+      _gstate5->supply_synced_at = current_time_point();
+   }
+
+   void system_contract::syncsupply() {
+      sync_supply();
    }
 
 
@@ -203,8 +317,8 @@ namespace eosiosystem {
 
       const time_point ct = current_time_point();
 
-      check((_gstate.thresh_activated_stake_time != time_point{ microseconds{0}})
-         || (_gstate.thresh_activated_stake_time <= ct), "cannot claim rewards until chain is activated" );
+      check((_gstate->thresh_activated_stake_time != time_point{ microseconds{0}})
+         || (_gstate->thresh_activated_stake_time <= ct), "cannot claim rewards until chain is activated" );
 
       
       // check( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
@@ -232,9 +346,13 @@ namespace eosiosystem {
       // This is okay because in this case the producer will not get paid anything either way.
       // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
 
+      // all blocks not paid yet: those flushed to producer rows and those still counted in unpaidblks
+      const uint32_t total_unpaid_blocks = _gstate->total_unpaid_blocks + counted_unpaid_blocks();
+      const uint32_t unpaid_blocks = prod.unpaid_blocks + take_unpaid_blocks( owner );
+
       int64_t producer_per_block_pay = 0;
-      if( _gstate.total_unpaid_blocks > 0 ) {
-         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / _gstate.total_unpaid_blocks;
+      if( total_unpaid_blocks > 0 ) {
+         producer_per_block_pay = (_gstate->perblock_bucket * unpaid_blocks) / total_unpaid_blocks;
       }
 
       double new_votepay_share = update_producer_votepay_share( prod2,
@@ -244,16 +362,16 @@ namespace eosiosystem {
                                  );
 
       int64_t producer_per_vote_pay = 0;
-      if( _gstate2.revision > 0 ) {
+      if( _gstate2->revision > 0 ) {
          double total_votepay_share = update_total_votepay_share( ct );
          if( total_votepay_share > 0 && !crossed_threshold ) {
-            producer_per_vote_pay = int64_t((new_votepay_share * _gstate.pervote_bucket) / total_votepay_share);
-            if( producer_per_vote_pay > _gstate.pervote_bucket )
-               producer_per_vote_pay = _gstate.pervote_bucket;
+            producer_per_vote_pay = int64_t((new_votepay_share * _gstate->pervote_bucket) / total_votepay_share);
+            if( producer_per_vote_pay > _gstate->pervote_bucket )
+               producer_per_vote_pay = _gstate->pervote_bucket;
          }
       } else {
-         if( _gstate.total_producer_vote_weight > 0 ) {
-            producer_per_vote_pay = int64_t((_gstate.pervote_bucket * prod.total_votes) / _gstate.total_producer_vote_weight);
+         if( _gstate->total_producer_vote_weight > 0 ) {
+            producer_per_vote_pay = int64_t((_gstate->pervote_bucket * prod.total_votes) / _gstate->total_producer_vote_weight);
          }
       }
 
@@ -261,9 +379,9 @@ namespace eosiosystem {
          producer_per_vote_pay = 0;
       }
 
-      _gstate.pervote_bucket      -= producer_per_vote_pay;
-      _gstate.perblock_bucket     -= producer_per_block_pay;
-      _gstate.total_unpaid_blocks -= prod.unpaid_blocks;
+      _gstate->pervote_bucket      -= producer_per_vote_pay;
+      _gstate->perblock_bucket     -= producer_per_block_pay;
+      _gstate->total_unpaid_blocks -= prod.unpaid_blocks;
 
       update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? prod.total_votes : 0.0) );
 
@@ -272,6 +390,10 @@ namespace eosiosystem {
          p.unpaid_blocks   = 0;
       });
 
+      if( producer_per_block_pay > 0 || producer_per_vote_pay > 0 ) {
+         flush_emission(); // eosio.bpay and eosio.vpay must hold the accrued inflation before paying out
+      }
+
       if( producer_per_block_pay > 0 ) {
          INLINE_ACTION_SENDER(eosio::token, transfer)(
             token_account, { {bpay_account, active_permission}, {owner, active_permission} },
@@ -1,326 +1,442 @@
 #include <eosio.system/eosio.system.hpp>
 
 #include <eosio.token/eosio.token.hpp>
+#include <eosio.system/staker.results.hpp>
 
 namespace eosiosystem {
 
    static constexpr uint64_t usecs_in_sec = 1000000;
-   static constexpr uint64_t _total_segments    = 1000000000;
+   static constexpr uint64_t _reward_index_scale = 1000000000000000000ull; // stakers_reward_index units per token unit
+   static constexpr size_t   _refreshmany_max = 100;  // stakers per refreshmany, keeps one call within the CPU limit
       
 
-   int64_t system_contract::get_emission_rate(int64_t current_step){
-      int64_t emission_rate = 0;
-
-      if      ( current_step <= 0 ){
-         emission_rate = 400000;
-      }
-      else if ( current_step == 1 ){
-         emission_rate = 380000;
-      }
-      else if ( current_step == 2 ){
-         emission_rate = 370000;
-      }
-      else if ( current_step == 3 ){
-         emission_rate = 340000;
+   /**
+    *  Per-block emission rate, in core token units, from the given step on. Steps are counted
+    *  from thresh_activated_stake_time in units of emission_step_in_usec; the last rate stays
+    *  in effect forever (but not more then max_cap).
+    */
+   struct emission_schedule_entry {
+      int64_t from_step;
+      int64_t rate;
+   };
+
+   static constexpr emission_schedule_entry emission_schedule[] = {
+      {   0, 400000 },
+      {   1, 380000 },
+      {   2, 370000 },
+      {   3, 340000 },
+      {   4, 320000 },
+      {   5, 300000 },
+      {   6, 240000 },
+      {  12, 180000 },
+      {  24, 120000 },
+      {  36, 100000 },
+      {  48,  90000 },
+      {  60,  80000 },
+      {  72,  70000 },
+      {  84,  60000 },
+      {  92,  50000 },
+      { 104,  40000 },
+   };
+
+   static constexpr size_t emission_schedule_size = sizeof(emission_schedule) / sizeof(emission_schedule[0]);
+
+   static constexpr bool emission_schedule_is_valid() {
+      if( emission_schedule[0].from_step != 0 ) return false;
+      for( size_t i = 0; i < emission_schedule_size; ++i ) {
+         // stakers' and owner's shares are taken as exact percentages of the rate
+         if( emission_schedule[i].rate <= 0 || emission_schedule[i].rate % 100 != 0 ) return false;
+         if( i > 0 && emission_schedule[i].from_step <= emission_schedule[i - 1].from_step ) return false;
+         if( i > 0 && emission_schedule[i].rate > emission_schedule[i - 1].rate ) return false;
       }
-      else if ( current_step == 4 ){
-         emission_rate = 320000;
-      }
-      else if ( current_step == 5 ){
-         emission_rate = 300000;
+      return true;
+   }
+   static_assert( emission_schedule_is_valid(), "emission schedule must start at step 0 with strictly increasing steps and non-increasing rates" );
+
+   /**
+    *  emission_schedule_prefix[i] is the emission of steps [0, emission_schedule[i].from_step)
+    *  in rate * steps.
+    */
+   struct emission_prefix_sums {
+      int64_t values[emission_schedule_size] = {};
+
+      constexpr emission_prefix_sums() {
+         for( size_t i = 1; i < emission_schedule_size; ++i ) {
+            values[i] = values[i - 1] + emission_schedule[i - 1].rate * ( emission_schedule[i].from_step - emission_schedule[i - 1].from_step );
+         }
       }
-      else if   ( current_step  < 12 ) {
-         emission_rate = 240000;
-      } else if ( current_step  < 24 ) {
-         emission_rate = 180000;
-      } else if ( current_step  < 36 ) {
-         emission_rate = 120000;
-      } else if ( current_step  < 48 ) {
-         emission_rate = 100000;
-      } else if ( current_step  < 60 ) {
-         emission_rate = 90000;
-      } else if ( current_step  < 72 ) {
-         emission_rate = 80000;
-      } else if ( current_step  < 84 ) {
-         emission_rate = 70000;
-      } else if ( current_step  < 92 ) {
-         emission_rate = 60000;
-      } else if ( current_step  < 104 ) {
-         emission_rate = 50000;
-      } else  {
-         emission_rate = 40000; //but not more then max_cap
+   };
+
+   static constexpr emission_prefix_sums emission_schedule_prefix{};
+   static_assert( emission_schedule_prefix.values[6] == 400000 + 380000 + 370000 + 340000 + 320000 + 300000, "emission prefix sums" );
+
+   /// index of the schedule entry in effect at the step
+   static constexpr size_t emission_schedule_index( int64_t step ) {
+      size_t lo = 0, hi = emission_schedule_size;
+      while( hi - lo > 1 ) {
+         const size_t mid = (lo + hi) / 2;
+         if( emission_schedule[mid].from_step <= step ) {
+            lo = mid;
+         } else {
+            hi = mid;
+         }
       }
+      return lo;
+   }
+   static_assert( emission_schedule_index(-1) == 0 && emission_schedule_index(11) == 6 && emission_schedule_index(104) == emission_schedule_size - 1,
+                  "emission schedule lookup" );
 
-      return emission_rate;
-      
+   int64_t system_contract::get_emission_rate(int64_t current_step){
+      return emission_schedule[ emission_schedule_index(current_step) ].rate;
    }
 
    int64_t system_contract::get_next_emission_rate(int64_t current_step) {
-      int64_t emission_rate = 0;
-
-      if      ( current_step <= 0 ){
-         emission_rate = 380000;
-      }
-      else if ( current_step == 1 ){
-         emission_rate = 370000;
-      }
-      else if ( current_step == 2 ){
-         emission_rate = 340000;
-      }
-      else if ( current_step == 3 ){
-         emission_rate = 320000;
-      }
-      else if ( current_step == 4 ){
-         emission_rate = 300000;
-      }
-      else if ( current_step == 5 ){
-         emission_rate = 240000;
-      }
-      else if   ( current_step  < 12 ) {
-         emission_rate = 180000;
-      } else if ( current_step  < 24 ) {
-         emission_rate = 120000;
-      } else if ( current_step  < 36 ) {
-         emission_rate = 100000;
-      } else if ( current_step  < 48 ) {
-         emission_rate = 90000;
-      } else if ( current_step  < 60 ) {
-         emission_rate = 80000;
-      } else if ( current_step  < 72 ) {
-         emission_rate = 70000;
-      } else if ( current_step  < 84 ) {
-         emission_rate = 60000;
-      } else if ( current_step  < 92 ) {
-         emission_rate = 50000;
-      } else {
-         emission_rate = 40000;
-      }
-
-      return emission_rate;
+      const size_t next = emission_schedule_index(current_step) + 1;
+      return next < emission_schedule_size ? emission_schedule[next].rate : emission_schedule[emission_schedule_size - 1].rate;
    }
 
    time_point system_contract::get_next_step_date(int64_t current_step) {
-      uint64_t next_step_offset = 0;
-
-      if( current_step < 0 ) current_step = 0;
-
-      if( current_step < 6 ) {
-         next_step_offset = current_step + 1;
-      } else if ( current_step  < 12 ) {
-         next_step_offset = 12;
-      } else if ( current_step  < 24 ) {
-         next_step_offset = 24;
-      } else if ( current_step  < 36 ) {
-         next_step_offset = 36;
-      } else if ( current_step  < 48 ) {
-         next_step_offset = 48;
-      } else if ( current_step  < 60 ) {
-         next_step_offset = 60;
-      } else if ( current_step  < 72 ) {
-         next_step_offset = 72;
-      } else if ( current_step  < 84 ) {
-         next_step_offset = 84;
-      } else if ( current_step  < 92 ) {
-         next_step_offset = 92;
-      } else if ( current_step  < 104 ) {
-         next_step_offset = 104;
-      }
+      const size_t next = emission_schedule_index(current_step) + 1;
 
       time_point next_step_date(microseconds(2524600800000000ll));//Jan 01 2050 00:00:00 GMT+0200
-      if( next_step_offset != 0 ) {
-    	  next_step_date = _gstate.thresh_activated_stake_time + microseconds(_gstate4.emission_step_in_usec * (next_step_offset));
+      if( next < emission_schedule_size ) {
+    	  next_step_date = _gstate->thresh_activated_stake_time + microseconds(_gstate4->emission_step_in_usec * emission_schedule[next].from_step);
       }
       return next_step_date;
    }
 
+   /**
+    *  Emission from activation up to the given time, in rate * microseconds.
+    */
+   uint128_t system_contract::cumulative_emission( time_point at ) {
+      const int64_t usecs = (at - _gstate->thresh_activated_stake_time).count();
+      if( usecs <= 0 ) {
+         return 0;
+      }
+
+      const int64_t step_usecs = _gstate4->emission_step_in_usec;
+      const size_t  i = emission_schedule_index( usecs / step_usecs );
+      const int64_t entry_start = emission_schedule[i].from_step * step_usecs;
+
+      return uint128_t( emission_schedule_prefix.values[i] ) * uint64_t( step_usecs )
+           + uint128_t( emission_schedule[i].rate ) * uint64_t( usecs - entry_start );
+   }
+
    void system_contract::activate(const time_point_sec activate_at, const uint64_t emission_step_in_sec){
       require_auth(_self);
       
       auto time = seconds(activate_at.sec_since_epoch());
-      _gstate.thresh_activated_stake_time = time_point{ microseconds{time}} ;
-
-      _gstate4.total_stakers_balance = 0;
-      _gstate4.total_stakers_cru_balance = asset(0, _cru_symbol);
-      _gstate4.total_stakers_frozen_cru_balance = asset(0, _cru_symbol);
-      _gstate4.total_stakers_wcru_balance = asset(0, _wcru_symbol);
-      _gstate4.total_stakers_frozen_wcru_balance = asset(0, _wcru_symbol);
-
-      _gstate4.stakers_bucket = asset(0, core_symbol());
-      _gstate4.emission_step_in_usec = emission_step_in_sec * uint64_t(usecs_in_sec);
-      _gstate4.total_cliffs_in_period = _gstate4.emission_step_in_usec / usecs_block_period;
-      _gstate4.current_emission_rate = asset(0, core_symbol());
+      _gstate->thresh_activated_stake_time = time_point{ microseconds{time}} ;
+
+      _gstate4->total_stakers_balance = 0;
+      _gstate4->total_stakers_cru_balance = asset(0, _cru_symbol);
+      _gstate4->total_stakers_frozen_cru_balance = asset(0, _cru_symbol);
+      _gstate4->total_stakers_wcru_balance = asset(0, _wcru_symbol);
+      _gstate4->total_stakers_frozen_wcru_balance = asset(0, _wcru_symbol);
+
+      _gstate4->stakers_bucket = asset(0, core_symbol());
+      _gstate4->emission_step_in_usec = emission_step_in_sec * uint64_t(usecs_in_sec);
+      _gstate4->total_cliffs_in_period = _gstate4->emission_step_in_usec / usecs_block_period;
+      _gstate4->current_emission_rate = asset(0, core_symbol());
       
-      _gstate4.next_emission_rate = asset(get_emission_rate(0), core_symbol());
-      _gstate4.next_emission_step_start_at = _gstate.thresh_activated_stake_time;
-      
-      _global4.set( _gstate4, _self );
+      _gstate4->next_emission_rate = asset(get_emission_rate(0), core_symbol());
+      _gstate4->next_emission_step_start_at = _gstate->thresh_activated_stake_time;
 
    }
 
 
    int64_t system_contract::get_current_emission_step(time_point last_update){
-      int64_t usecs_since_activate = (last_update - _gstate.thresh_activated_stake_time).count();
-      int64_t step = usecs_since_activate / _gstate4.emission_step_in_usec;
+      int64_t usecs_since_activate = (last_update - _gstate->thresh_activated_stake_time).count();
+      int64_t step = usecs_since_activate / _gstate4->emission_step_in_usec;
 
       return step;
    }
 
 
-   time_point system_contract::get_left_time_border(time_point last_update){
-      int64_t limit = get_current_emission_step(last_update);
-      const auto time = static_cast<int64_t>(limit * _gstate4.emission_step_in_usec);
-      time_point left_time_border = _gstate.thresh_activated_stake_time + time_point{ microseconds{time}};
+   /**
+    *  Stakers' emission over [from, to) weighted by time, in token units times microseconds
+    *  of block period. Divide by usecs_block_period to get token units.
+    *  Every rate is a multiple of 100, so the percentage split is exact on the sums.
+    */
+   uint128_t system_contract::stakers_emission_between( time_point from, time_point to ) {
+      if( _gstate4->emission_step_in_usec == 0 || to <= from ) {
+         return 0; // emission schedule not activated yet
+      }
 
-      return left_time_border;
-   }
+      // the stakers' share changed at upd_percentage_time_point
+      const uint32_t stakers_percent_before = 95;
+      const uint32_t stakers_percent_after  = 100 - owner_percent - producers_percent;
 
+      uint128_t emission = 0;
+      if( from < upd_percentage_time_point ) {
+         const time_point end = to < upd_percentage_time_point ? to : upd_percentage_time_point;
+         emission += ( cumulative_emission( end ) - cumulative_emission( from ) ) * stakers_percent_before / 100;
+         from = end;
+      }
+      if( from < to ) {
+         emission += ( cumulative_emission( to ) - cumulative_emission( from ) ) * stakers_percent_after / 100;
+      }
+      return emission;
+   }
 
-   time_point system_contract::get_right_time_border( time_point last_update, time_point ct ) {
-      int64_t limit = get_current_emission_step(last_update) + 1;
-      const auto time = static_cast<int64_t>(limit * _gstate4.emission_step_in_usec );
+   /**
+    *  Advances the cumulative stakers reward per staked unit up to the current time.
+    *  Must run before total_stakers_balance changes.
+    */
+   void system_contract::update_stakers_index() {
+      const time_point ct = current_time_point();
+
+      if( _gstate5->stakers_index_started_at == time_point() ) {
+         _gstate5->stakers_index_started_at = ct;
+         _gstate5->stakers_index_updated_at = ct;
+         return;
+      }
 
-      time_point limited_right_time_border = _gstate.thresh_activated_stake_time + time_point{ microseconds{time}};
+      if( ct <= _gstate5->stakers_index_updated_at ) {
+         return;
+      }
 
-      if( ct >= limited_right_time_border ) {
-         
-         return limited_right_time_border;
+      if( _gstate4->total_stakers_balance > 0 ) {
+         const uint128_t emission = stakers_emission_between( _gstate5->stakers_index_updated_at, ct );
+         _gstate5->stakers_reward_index += emission * ( _reward_index_scale / usecs_block_period ) / _gstate4->total_stakers_balance;
       }
-      else {
-         return ct;
+      _gstate5->stakers_index_updated_at = ct;
+   }
+
+   /**
+    *  Credits the reward accrued since the staker's last refresh. update_stakers_index must
+    *  have run in the same action.
+    */
+   void system_contract::settle_staker(staker_v2& s, time_point ct) {
+      if (s.last_update_at >= ct)
+        return;
+
+      const uint128_t reward_index = _gstate5->stakers_reward_index;
+      const uint128_t user_emission_amount = uint128_t(s.staked_balance()) * (reward_index - s.reward_index) / _reward_index_scale;
+
+      asset user_emission_in_period = asset(int64_t(user_emission_amount), _emit_symbol);
+
+#if STAKER_DEBUG_PRINT
+      print("stakers_bucket_now:", _gstate4->stakers_bucket, ";");
+      print("user_emission_in_period:", user_emission_in_period, ";");
+#endif
+
+      // the index follows the emission schedule, also once max supply stops the mints; never pay out
+      // more than was emitted, what is cut is counted in stakers_shortfall
+      if (user_emission_in_period > _gstate4->stakers_bucket) {
+         _gstate5->stakers_shortfall += (user_emission_in_period - _gstate4->stakers_bucket).amount;
+         user_emission_in_period = _gstate4->stakers_bucket;
       }
 
+      s.last_update_at = ct;
+      s.reward_index = reward_index;
+      s.emitted += user_emission_in_period.amount;
+
+      _gstate4->stakers_bucket -= user_emission_in_period;
+
+#if STAKER_DEBUG_PRINT
+      print("stakers_bucket_updated:", _gstate4->stakers_bucket, ";");
+#endif
+#if STAKER_REFRESH_RESULTS
+      // dummy action added so that the credited reward shows up in action trace
+      staker_results::refreshresult_action refreshresult_act( stake_account, std::vector<eosio::permission_level>{ } );
+      refreshresult_act.send( s.username, user_emission_in_period.amount, reward_index, _gstate4->stakers_bucket.amount );
+#endif
    }
-    
 
-   void system_contract::refresh(const eosio::name username){
-      // require_auth(username); 
- 
+   stakers_v2_index::const_iterator system_contract::find_staker(stakers_v2_index& stakers, const eosio::name username) {
+      auto st = stakers.find(username.value);
+      if (st == stakers.end() && !_gstate5->stakers_migrated) {
+         st = migrate_staker(stakers, username);
+      }
+      return st;
+   }
+
+   /**
+    *  Moves the staker's stakers, stakers2 and stakers3 rows into one stakerv2 row.
+    *  Returns stakers.end() if there was nothing to move.
+    */
+   stakers_v2_index::const_iterator system_contract::migrate_staker(stakers_v2_index& stakers, const eosio::name username) {
       stakers_index stakers_instance(_self, _self.value);
-      
       stakers2_index stakers2_instance(_self, _self.value);
-
-      time_point ct = current_time_point();
-
-      check((_gstate.thresh_activated_stake_time != time_point{ microseconds{0}})
-         || (_gstate.thresh_activated_stake_time <= ct), "cannot refresh rewards until chain is activated" );
+      stakers3_index stakers3_instance(_self, _self.value);
 
       auto st = stakers_instance.find(username.value);
-      if (st == stakers_instance.end())
-        return;
-      time_point current_update_at = st->last_update_at;
-
       auto st2 = stakers2_instance.find(username.value);
-      
-      if (st2 != stakers2_instance.end()) {
-         current_update_at = st2 -> current_update_at;
-      };
+      auto st3 = stakers3_instance.find(username.value);
 
-      if (st != stakers_instance.end()){
-         if (current_update_at < ct){
+      if (st2 != stakers2_instance.end()) {
+         stakers2_instance.erase(st2);
+      }
+      if (st == stakers_instance.end() && st3 == stakers3_instance.end()) {
+         return stakers.end();
+      }
 
-            bool updtokenomics = false;
-            if( current_update_at < upd_percentage_time_point &&  upd_percentage_time_point < ct ) {
-                ct = upd_percentage_time_point;
-            }
-            if( ct > upd_percentage_time_point ) {
-                updtokenomics = true;
+      // the legacy catch-up below needs the index started
+      update_stakers_index();
+
+      staker_v2 row;
+      row.username = username;
+
+      if (st != stakers_instance.end()) {
+         row.last_update_at = st->last_update_at;
+         row.staked_cru = st->staked_cru_balance.amount;
+         row.staked_wcru = st->staked_wcru_balance.amount;
+         row.staked_frozen_wcru = st->staked_frozen_wcru_balance.amount;
+         row.emitted = st->emitted_balance.amount;
+
+         // last settled by per-step refresh before the index existed, catch up to the index start
+         // and accrue the whole index from there on. The catch-up shares the emission by the
+         // total_stakers_balance of now, the totals of the period itself are not kept; stakers that
+         // joined or left in between shift it
+         const time_point index_started_at = _gstate5->stakers_index_started_at;
+         if (st->last_update_at < index_started_at && _gstate4->total_stakers_balance > 0) {
+            asset catch_up = asset(int64_t(uint128_t(st->staked_balance)
+                                           * stakers_emission_between(st->last_update_at, index_started_at)
+                                           / (uint128_t(usecs_block_period) * _gstate4->total_stakers_balance)), _emit_symbol);
+            if (catch_up > _gstate4->stakers_bucket) {
+               _gstate5->stakers_shortfall += (catch_up - _gstate4->stakers_bucket).amount;
+               catch_up = _gstate4->stakers_bucket;
             }
+            row.emitted += catch_up.amount;
+            _gstate4->stakers_bucket -= catch_up;
+         }
+         row.reward_index = 0;
+         stakers_instance.erase(st);
+      } else {
+         row.reward_index = _gstate5->stakers_reward_index;
+      }
 
-            if (st2 == stakers2_instance.end()){
-               stakers2_instance.emplace(_self, [&](auto &s2){
-                  s2.username = username;
-                  s2.current_update_at = ct;
-               });
-            } else {
-               stakers2_instance.modify(st2, _self, [&](auto &s2){
-                  s2.current_update_at = ct;
-               });
-            };
+      if (st3 != stakers3_instance.end()) {
+         row.cru_on_withdraw = st3->cru_on_widthdraw.amount;
+         row.wcru_on_withdraw = st3->wcru_on_widthdraw.amount;
+         row.withdraw_updated_at = st3->last_update_at;
+         stakers3_instance.erase(st3);
+      }
 
-            // check(st->staked_balance.amount > 0, "Nothing is not staked for refresh");
+      return stakers.emplace(_self, [&](auto &s){
+         s = row;
+      });
+   }
 
-            time_point right_time_border = get_right_time_border(st->last_update_at, ct);
-            time_point left_time_border = get_left_time_border(st->last_update_at);
-            
-            uint64_t current_step = get_current_emission_step(left_time_border);
-            uint64_t next_step = current_step + 1;
+   void system_contract::migratestkr(uint32_t max_rows) {
+      require_auth(_self);
 
-            uint64_t emission_rate = get_emission_rate(current_step);
-            print("emission_rate:", emission_rate, ";");
+      stakers_v2_index stakers(_self, _self.value);
+      uint32_t i = 0;
 
-            uint64_t to_producers_and_owner;
-            if( updtokenomics ) {
-               to_producers_and_owner = emission_rate * ( owner_percent + producers_percent ) / 100; // 60%
-            } else {
-               to_producers_and_owner = emission_rate / 20; // 5%
-            }
+      stakers_index stakers_instance(_self, _self.value);
+      for (auto st = stakers_instance.begin(); st != stakers_instance.end() && i < max_rows; st = stakers_instance.begin(), ++i) {
+         migrate_staker(stakers, st->username);
+      }
 
-            uint64_t to_stakers = emission_rate - to_producers_and_owner; // 40% or 95%
+      // stakers who had fully unstaked only have a withdraw row left
+      stakers3_index stakers3_instance(_self, _self.value);
+      for (auto st3 = stakers3_instance.begin(); st3 != stakers3_instance.end() && i < max_rows; st3 = stakers3_instance.begin(), ++i) {
+         migrate_staker(stakers, st3->username);
+      }
+
+      stakers2_index stakers2_instance(_self, _self.value);
+      for (auto st2 = stakers2_instance.begin(); st2 != stakers2_instance.end() && i < max_rows; ++i) {
+         st2 = stakers2_instance.erase(st2);
+      }
 
-            eosio::asset total_emission_in_period = asset(to_stakers * _gstate4.total_cliffs_in_period, _emit_symbol);
-            print("total_emission_in_period:", total_emission_in_period, ";");
+      if (stakers_instance.begin() == stakers_instance.end() && stakers2_instance.begin() == stakers2_instance.end()
+          && stakers3_instance.begin() == stakers3_instance.end()) {
+         _gstate5->stakers_migrated = true;
+      }
+   }
 
-            auto user_last_position = st->last_update_at > left_time_border ? st->last_update_at : left_time_border;
+   void system_contract::refresh(const eosio::name username){
+      // require_auth(username); 
 
-            check(right_time_border >= user_last_position, "right_time_border < user_last_position");
+      time_point ct = current_time_point();
 
-            uint64_t user_cliffs_in_period = ((right_time_border - user_last_position)).count() / usecs_block_period;
-            print("user_cliffs_in_period:", user_cliffs_in_period, ";");
+      check((_gstate->thresh_activated_stake_time != time_point{ microseconds{0}})
+         || (_gstate->thresh_activated_stake_time <= ct), "cannot refresh rewards until chain is activated" );
 
-            double user_share_in_segments = (double)st->staked_balance / (double)_gstate4.total_stakers_balance * (double)_total_segments;
-            print("user_share_in_segments:", user_share_in_segments, ";");
-            double user_emission_in_period_in_segments = (double)user_cliffs_in_period / (double)_gstate4.total_cliffs_in_period * (double)user_share_in_segments * (double)total_emission_in_period.amount;
-            print("user_emission_in_period_in_segments:", user_emission_in_period_in_segments, ";");
-            asset user_emission_in_period = asset((uint64_t)user_emission_in_period_in_segments / _total_segments, _emit_symbol);
-            
-            print("stakers_bucket_now:", _gstate4.stakers_bucket, ";");
+      update_stakers_index();
 
-            print("user_emission_in_period:", user_emission_in_period, ";");
+      stakers_v2_index stakers(_self, _self.value);
 
+      auto st = find_staker(stakers, username);
+      if (st == stakers.end() || st->last_update_at >= ct)
+        return;
 
-            stakers_instance.modify(st, _self, [&](auto &s){
-               s.last_update_at = right_time_border;
-               s.emitted_segments += user_emission_in_period_in_segments;
-               s.emitted_balance += user_emission_in_period;
-            });     
-            
+      stakers.modify(st, same_payer, [&](auto &s){
+         settle_staker(s, ct);
+      });
+   }
 
-            check(user_emission_in_period <= _gstate4.stakers_bucket, "System error");
 
-            _gstate4.stakers_bucket -= user_emission_in_period;
-            print("stakers_bucket_updated:", _gstate4.stakers_bucket, ";");
-         }
+   /**
+    *  Settles the given stakers in one action, global state is read and written once.
+    */
+   void system_contract::refreshmany(const std::vector<eosio::name>& usernames){
+      check(usernames.size() <= _refreshmany_max, "too many stakers, at most 100 per refreshmany");
+      time_point ct = current_time_point();
+      update_stakers_index();
+
+      stakers_v2_index stakers(_self, _self.value);
+
+      for (const auto& username : usernames) {
+         auto st = find_staker(stakers, username);
+         if (st == stakers.end() || st->last_update_at >= ct)
+           continue;
+
+         stakers.modify(st, same_payer, [&](auto &s){
+            settle_staker(s, ct);
+         });
       }
    }
 
+   /**
+    *  Settles up to max_rows stakers, least recently refreshed first; at most as many as refreshmany.
+    */
+   void system_contract::refreshcrank(uint16_t max_rows){
+      check(max_rows <= _refreshmany_max, "too many stakers, at most 100 per refreshcrank");
+      time_point ct = current_time_point();
+      update_stakers_index();
+
+      stakers_v2_index stakers(_self, _self.value);
+      auto idx = stakers.get_index<"byupdate"_n>();
+
+      // a settled row moves to the end of the index, so the stalest row is always at begin()
+      for (uint16_t i = 0; i < max_rows; ++i) {
+         auto st = idx.begin();
+         if (st == idx.end() || st->last_update_at >= ct)
+           break;
+
+         idx.modify(st, same_payer, [&](auto &s){
+            settle_staker(s, ct);
+         });
+      }
+   }
 
    void system_contract::frunstake(const eosio::name username, const eosio::asset quantity) {
       require_auth(_tokenlock);
-	
-      system_contract::refresh(username);
-      system_contract::refresh(username);
 
-      stakers_index stakers_instance(_self, _self.value);
-
-      auto st = stakers_instance.find(username.value);
+      time_point ct = current_time_point();
+      update_stakers_index();
 
-      if (st != stakers_instance.end()){
-         check(st -> staked_frozen_wcru_balance.amount >= quantity.amount, "Not enought frozen tokens for unstake");      
-         check(st -> staked_balance >= quantity.amount, "Not enought tokens for unstake");     
+      stakers_v2_index stakers(_self, _self.value);
 
-         check(st -> last_update_at == current_time_point(), "Impossible unstake not refreshed balance. Refresh balance first and try again.");
+      auto st = find_staker(stakers, username);
 
+      if (st != stakers.end()){
+         check(st -> staked_frozen_wcru >= quantity.amount, "Not enought frozen tokens for unstake");      
+         check(st -> staked_balance() >= uint64_t(quantity.amount), "Not enought tokens for unstake");     
 
-         stakers_instance.modify(st, username, [&](auto &s){
-            s.staked_balance -= quantity.amount;
-            s.staked_wcru_balance -= quantity;
-            s.staked_frozen_wcru_balance -= quantity;        
+         stakers.modify(st, same_payer, [&](auto &s){
+            settle_staker(s, ct);
+            s.staked_wcru -= quantity.amount;
+            s.staked_frozen_wcru -= quantity.amount;        
          });
 
      
-         _gstate4.total_stakers_balance -= quantity.amount;
-         _gstate4.total_stakers_frozen_wcru_balance -= quantity;
-         _gstate4.total_stakers_wcru_balance -= quantity;   
+         _gstate4->total_stakers_balance -= quantity.amount;
+         _gstate4->total_stakers_frozen_wcru_balance -= quantity;
+         _gstate4->total_stakers_wcru_balance -= quantity;   
       }
       
    }
@@ -330,42 +446,34 @@ namespace eosiosystem {
       eosio::check(quantity.symbol == _wcru_symbol, "Wrong token symbol for staking");
       
       auto ct = current_time_point();
-      
-      system_contract::refresh(username);
-      system_contract::refresh(username);
+      update_stakers_index();
 
-      stakers_index stakers_instance(_self, _self.value);
+      stakers_v2_index stakers(_self, _self.value);
       
-      auto st = stakers_instance.find(username.value);
+      auto st = find_staker(stakers, username);
       
-      if (st == stakers_instance.end()){
+      if (st == stakers.end()){
 
-         stakers_instance.emplace(_self, [&](auto &s){
+         stakers.emplace(_self, [&](auto &s){
             s.username = username;
             s.last_update_at = ct;
-            s.staked_balance = quantity.amount;
-            s.staked_frozen_wcru_balance = quantity;
-            s.staked_cru_balance = asset(0, _cru_symbol);
-            s.staked_frozen_cru_balance = asset(0, _cru_symbol);
-            s.staked_wcru_balance = quantity;
-            s.emitted_segments = 0;
-            s.emitted_balance = asset(0, _emit_symbol);
+            s.staked_wcru = quantity.amount;
+            s.staked_frozen_wcru = quantity.amount;
+            s.reward_index = _gstate5->stakers_reward_index;
          });
          
       } else {
 
-         check(st -> last_update_at == ct, "Impossible to stake before full refresh balance.");
-
-         stakers_instance.modify(st ,_self, [&](auto &s){
-            s.staked_balance += quantity.amount;
-            s.staked_wcru_balance += quantity;
-            s.staked_frozen_wcru_balance += quantity;
+         stakers.modify(st, same_payer, [&](auto &s){
+            settle_staker(s, ct);
+            s.staked_wcru += quantity.amount;
+            s.staked_frozen_wcru += quantity.amount;
          });
       }
 
-      _gstate4.total_stakers_balance += quantity.amount;
-      _gstate4.total_stakers_frozen_wcru_balance += quantity;
-      _gstate4.total_stakers_wcru_balance += quantity;
+      _gstate4->total_stakers_balance += quantity.amount;
+      _gstate4->total_stakers_frozen_wcru_balance += quantity;
+      _gstate4->total_stakers_wcru_balance += quantity;
 
 
  }
@@ -384,46 +492,32 @@ namespace eosiosystem {
       }
       
       time_point ct = current_time_point();
+#if STAKER_DEBUG_PRINT
       print("token_supply: ", token_supply);
       print("quantity: ", quantity);
+#endif
       
       eosio::check(token_supply >= quantity, "Not enought balance for stake");
 
-      system_contract::refresh(username);
-      system_contract::refresh(username);
+      update_stakers_index();
 
-      stakers_index stakers_instance(_self, _self.value);
+      stakers_v2_index stakers(_self, _self.value);
       
-      auto st = stakers_instance.find(username.value);
+      auto st = find_staker(stakers, username);
       
       
-      if (st == stakers_instance.end()){
-         stakers_instance.emplace(_self, [&](auto &s){
+      if (st == stakers.end()){
+         stakers.emplace(_self, [&](auto &s){
             s.username = username;
             s.last_update_at = ct;
-            s.staked_balance = quantity.amount;
-            s.staked_frozen_wcru_balance = asset(0, _wcru_symbol);
-
-            if (quantity.symbol == _cru_symbol){
-               s.staked_cru_balance = quantity;
-               s.staked_wcru_balance = asset(0, _wcru_symbol);
-            } else {
-               s.staked_cru_balance = asset(0, _cru_symbol);
-               s.staked_wcru_balance = quantity;
-            }
-
-            s.emitted_segments = 0;
-            s.emitted_balance = asset(0, _emit_symbol);
+            quantity.symbol == _cru_symbol ? s.staked_cru = quantity.amount : s.staked_wcru = quantity.amount;
+            s.reward_index = _gstate5->stakers_reward_index;
          });
       } else {
 
-         check(st -> last_update_at == ct, "Impossible to stake before full refresh balance.");
-
-         stakers_instance.modify(st ,_self, [&](auto &s){
-            s.staked_balance += quantity.amount;
-
-            quantity.symbol == _cru_symbol ? s.staked_cru_balance += quantity : s.staked_wcru_balance += quantity;
-               
+         stakers.modify(st, same_payer, [&](auto &s){
+            settle_staker(s, ct);
+            quantity.symbol == _cru_symbol ? s.staked_cru += quantity.amount : s.staked_wcru += quantity.amount;
          });
       }
 
@@ -449,9 +543,9 @@ namespace eosiosystem {
      ).send();
 
 
-      _gstate4.total_stakers_balance += quantity.amount;
+      _gstate4->total_stakers_balance += quantity.amount;
 
-      quantity.symbol == _cru_symbol ? _gstate4.total_stakers_cru_balance += quantity : _gstate4.total_stakers_wcru_balance += quantity;
+      quantity.symbol == _cru_symbol ? _gstate4->total_stakers_cru_balance += quantity : _gstate4->total_stakers_wcru_balance += quantity;
 
 
    }
@@ -459,45 +553,47 @@ namespace eosiosystem {
    void system_contract::frwithdraw(const eosio::name username){
       require_auth(username);
 
-      stakers3_index stakers3_instance(_self, _self.value);
-      auto staker = stakers3_instance.find(username.value);
+      stakers_v2_index stakers(_self, _self.value);
+      auto staker = find_staker(stakers, username);
       
-      if (staker != stakers3_instance.end() && staker->last_update_at + microseconds(3 * useconds_per_day) < current_time_point()) {
-         if (staker -> cru_on_widthdraw.amount > 0 || staker -> wcru_on_widthdraw.amount > 0){
+      if (staker != stakers.end() && staker->withdraw_updated_at + microseconds(3 * useconds_per_day) < current_time_point()) {
+         if (staker -> cru_on_withdraw > 0 || staker -> wcru_on_withdraw > 0){
             
-            if (staker -> cru_on_widthdraw.amount > 0) {
+            if (staker -> cru_on_withdraw > 0) {
+               const asset cru_on_withdraw = asset(staker -> cru_on_withdraw, _cru_symbol);
                INLINE_ACTION_SENDER(eosio::token, transfer)(
                   token_account, { {stake_account, active_permission} },
-                  { stake_account, username, staker -> cru_on_widthdraw, std::string("unstake it!") }
+                  { stake_account, username, cru_on_withdraw, std::string("unstake it!") }
                );
 
               action(
                 permission_level{_self,"active"_n},
                 _tokenlock,
                 name("chlbal"),
-                std::make_tuple(username, - staker -> cru_on_widthdraw, uint64_t(0))
+                std::make_tuple(username, - cru_on_withdraw, uint64_t(0))
               ).send();
             };
 
-            if (staker -> wcru_on_widthdraw.amount > 0) {
+            if (staker -> wcru_on_withdraw > 0) {
+               const asset wcru_on_withdraw = asset(staker -> wcru_on_withdraw, _wcru_symbol);
                INLINE_ACTION_SENDER(eosio::token, transfer)(
                   token_account, { {stake_account, active_permission} },
-                  { stake_account, username, staker -> wcru_on_widthdraw, std::string("unstake it!") }
+                  { stake_account, username, wcru_on_withdraw, std::string("unstake it!") }
                );
 
               action(
                 permission_level{_self,"active"_n},
                 _tokenlock,
                 name("chlbal"),
-                std::make_tuple(username, - staker -> wcru_on_widthdraw, uint64_t(0))
+                std::make_tuple(username, - wcru_on_withdraw, uint64_t(0))
               ).send();
 
             };
 
-            stakers3_instance.modify(staker, username, [&](auto &s){
-               s.last_update_at = current_time_point();
-               s.cru_on_widthdraw -= staker -> cru_on_widthdraw;
-               s.wcru_on_widthdraw -= staker -> wcru_on_widthdraw;
+            stakers.modify(staker, same_payer, [&](auto &s){
+               s.withdraw_updated_at = current_time_point();
+               s.cru_on_withdraw = 0;
+               s.wcru_on_withdraw = 0;
             });
          }
       }
@@ -508,72 +604,43 @@ namespace eosiosystem {
       require_auth(username);
 
       time_point ct = current_time_point();
-      system_contract::refresh(username);
+      update_stakers_index();
 
-      stakers_index stakers_instance(_self, _self.value);
+      stakers_v2_index stakers(_self, _self.value);
 
-      auto st = stakers_instance.find(username.value);
+      auto st = find_staker(stakers, username);
 
-      check(st != stakers_instance.end(), "Username is not found");
+      check(st != stakers.end(), "Username is not found");
 
       if (quantity.symbol == _cru_symbol){
-         check((st -> staked_cru_balance).amount >= quantity.amount, "Not enough tokens for unstake");
+         check(st -> staked_cru >= quantity.amount, "Not enough tokens for unstake");
       } else if (quantity.symbol == _wcru_symbol) {
-         check((st -> staked_wcru_balance).amount >= quantity.amount, "Not enough tokens for unstake");
+         check(st -> staked_wcru >= quantity.amount, "Not enough tokens for unstake");
       } else {
          check(false, "Wrong stake token symbol");
       }
       
-      check(st -> staked_balance >= quantity.amount, "Not enough tokens for unstake");
-      
-
-      check( st->last_update_at >= ct, "Impossible unstake not refreshed balance. Refresh balance first and try again.");
-
-      stakers_instance.modify(st, username, [&](auto &s){
-
-         s.staked_balance -= quantity.amount;
-         
-         quantity.symbol == _cru_symbol ? s.staked_cru_balance -= quantity : s.staked_wcru_balance -= quantity;
-        
+      check(st -> staked_balance() >= uint64_t(quantity.amount), "Not enough tokens for unstake");
+
+      //FREEZE tokens on withdraw
+      stakers.modify(st, same_payer, [&](auto &s){
+         settle_staker(s, ct);
+
+         if (quantity.symbol == _cru_symbol){
+            s.staked_cru -= quantity.amount;
+            s.cru_on_withdraw += quantity.amount;
+         } else {
+            s.staked_wcru -= quantity.amount;
+            s.wcru_on_withdraw += quantity.amount;
+         }
+         s.withdraw_updated_at = ct;
       });
   
-      _gstate4.total_stakers_balance -= quantity.amount;
+      _gstate4->total_stakers_balance -= quantity.amount;
       if( quantity.symbol == _cru_symbol ) {
-    	 _gstate4.total_stakers_cru_balance -= quantity;
-      } else {
-         _gstate4.total_stakers_wcru_balance -= quantity;
-      }
-      
-
-      
-     //FREEZE tokens on withdraw
-      stakers3_index stakers3_instance(_self, _self.value);
-      auto staker = stakers3_instance.find(username.value);
-      if (staker == stakers3_instance.end()){
-         stakers3_instance.emplace(username, [&](auto &s){
-            s.username = username;
-            s.last_update_at = current_time_point();
-            if (quantity.symbol == _cru_symbol){
-               s.cru_on_widthdraw = quantity;
-               s.wcru_on_widthdraw = asset(0, _wcru_symbol);
-            } else if (quantity.symbol == _wcru_symbol){
-               s.cru_on_widthdraw = asset(0, _cru_symbol);
-               s.wcru_on_widthdraw = quantity;
-            } else {
-               eosio::check(false, "Only CRU or WCRU symbols can be unstaked");
-            };
-         });
+    	 _gstate4->total_stakers_cru_balance -= quantity;
       } else {
-         stakers3_instance.modify(staker, username, [&](auto &s){
-            s.last_update_at = current_time_point();
-            if (quantity.symbol == _cru_symbol){
-               s.cru_on_widthdraw += quantity;
-            } else if (quantity.symbol == _wcru_symbol){
-               s.wcru_on_widthdraw += quantity;
-            } else {
-               eosio::check(false, "Only CRU or WCRU symbols can be unstaked");
-            };
-         });
+         _gstate4->total_stakers_wcru_balance -= quantity;
       }
 
      action(
@@ -588,26 +655,22 @@ namespace eosiosystem {
    void system_contract::getreward(const eosio::name username, const eosio::asset to_withdraw){
       require_auth(username);
 
-      stakers_index stakers_instance(_self, _self.value);
+      stakers_v2_index stakers(_self, _self.value);
       
-      auto st = stakers_instance.find(username.value);
+      auto st = find_staker(stakers, username);
 
-      check(st != stakers_instance.end(), "Username is not found");
+      check(st != stakers.end(), "Username is not found");
 
-      check((st -> emitted_balance).amount > 0, "Nothing to withdraw");
+      check(st -> emitted > 0, "Nothing to withdraw");
       check(to_withdraw.symbol == _emit_symbol, "Wrong symbol for get reward");
-      asset available_withdraw = st -> emitted_balance;
       
-      check(available_withdraw >= to_withdraw, "Not enought emitted balance for withdraw");
+      check(st -> emitted >= to_withdraw.amount, "Not enought emitted balance for withdraw");
 
-      
-      double segments = to_withdraw.amount * _total_segments;
-
-      stakers_instance.modify(st, username, [&](auto &s){
-         s.emitted_balance = available_withdraw - to_withdraw;
-         s.emitted_segments -= segments;
+      stakers.modify(st, same_payer, [&](auto &s){
+         s.emitted -= to_withdraw.amount;
       });
-  
+
+      flush_emission(); // eosio.saving must hold the accrued inflation before paying out
 
       INLINE_ACTION_SENDER(eosio::token, transfer)(
          token_account, { {saving_account, active_permission} },
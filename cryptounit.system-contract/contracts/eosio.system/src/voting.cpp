@@ -1,4 +1,5 @@
 #include <eosio.system/eosio.system.hpp>
+#include <eosio.system/vote_weight.hpp>
 
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/crypto.h>
@@ -44,6 +45,7 @@ namespace eosiosystem {
             if ( info.last_claim_time == time_point() )
                info.last_claim_time = ct;
          });
+         rank_producer( *prod );
 
          auto prod2 = _producers2.find( producer.value );
          if ( prod2 == _producers2.end() ) {
@@ -79,21 +81,26 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&]( producer_info& info ){
          info.deactivate();
       });
+      rank_producer( prod );
    }
 
    void system_contract::update_elected_producers( block_timestamp block_time ) {
-      _gstate.last_producer_schedule_update = block_time;
+      _gstate->last_producer_schedule_update = block_time;
 
-      auto idx = _producers.get_index<"prototalvote"_n>();
+      if( !_top_producers->built || (_top_producers->producers.size() < 21 && _top_producers->cutoff > 0) ) {
+         rebuild_top_producers();
+      }
 
       std::vector< std::pair<eosio::producer_key,uint16_t> > top_producers;
       top_producers.reserve(21);
 
-      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
-         top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
+      for ( const auto& rank : _top_producers->producers ) {
+         if ( top_producers.size() == 21 )
+            break;
+         top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{rank.owner, rank.producer_key}, rank.location}) );
       }
 
-      if ( top_producers.size() < _gstate.last_producer_schedule_size ) {
+      if ( top_producers.size() < _gstate->last_producer_schedule_size ) {
          return;
       }
 
@@ -108,15 +115,96 @@ namespace eosiosystem {
 
       auto packed_schedule = pack(producers);
 
+      _gstate5->schedule_recomputes++;
+
+      capi_checksum256 schedule_hash;
+      sha256( packed_schedule.data(), packed_schedule.size(), &schedule_hash );
+      if( std::equal( std::begin(schedule_hash.hash), std::end(schedule_hash.hash), std::begin(_gstate5->last_schedule_hash.hash) ) ) {
+         _gstate5->schedule_skips++;
+         return;
+      }
+
+      // -1 while an earlier proposal waits to become pending, the schedule is then built again next time
       if( set_proposed_producers( packed_schedule.data(),  packed_schedule.size() ) >= 0 ) {
-         _gstate.last_producer_schedule_size = static_cast<decltype(_gstate.last_producer_schedule_size)>( top_producers.size() );
+         _gstate->last_producer_schedule_size = static_cast<decltype(_gstate->last_producer_schedule_size)>( top_producers.size() );
+         _gstate5->last_schedule_hash = schedule_hash;
+
+         std::vector<name> next_producers;
+         next_producers.reserve( producers.size() );
+         for( const auto& p : producers )
+            next_producers.push_back( p.producer_name );
+         flush_unpaid_blocks( next_producers );
+      }
+   }
+
+   /// order of top_producers_state::producers, same as the prototalvote index for active producers
+   bool ranks_before( const producer_rank& a, const producer_rank& b ) {
+      return a.total_votes > b.total_votes || (a.total_votes == b.total_votes && a.owner < b.owner);
+   }
+
+   /**
+    *  Updates the ranking after the votes, the key or the active flag of a producer changed. Only
+    *  the changed entry moves, so this is linear in top_producers_size.
+    */
+   void system_contract::rank_producer( const producer_info& prod ) {
+      auto& top = *_top_producers;
+      if( !top.built ) {
+         return;
+      }
+
+      auto& ranks = top.producers;
+      auto it = std::find_if( ranks.begin(), ranks.end(), [&]( const producer_rank& r ) { return r.owner == prod.owner; } );
+      const bool ranked = prod.active() && 0 < prod.total_votes && prod.total_votes >= top.cutoff;
+      if( it == ranks.end() ) {
+         if( !ranked ) {
+            return;
+         }
+         it = ranks.insert( ranks.end(), producer_rank{ prod.owner, prod.total_votes, prod.producer_key, prod.location } );
+      } else if( !ranked ) {
+         ranks.erase( it );
+         return;
+      } else {
+         it->total_votes = prod.total_votes;
+         it->producer_key = prod.producer_key;
+         it->location = prod.location;
+      }
+
+      size_t i = it - ranks.begin();
+      while( i > 0 && ranks_before( ranks[i], ranks[i-1] ) ) {
+         std::swap( ranks[i], ranks[i-1] );
+         --i;
+      }
+      while( i + 1 < ranks.size() && ranks_before( ranks[i+1], ranks[i] ) ) {
+         std::swap( ranks[i], ranks[i+1] );
+         ++i;
+      }
+
+      if( ranks.size() > top_producers_size ) {
+         top.cutoff = ranks.back().total_votes;
+         ranks.pop_back();
+      }
+   }
+
+   void system_contract::rebuild_top_producers() {
+      auto& top = *_top_producers;
+      top.producers.clear();
+      top.cutoff = 0;
+
+      auto idx = _producers.get_index<"prototalvote"_n>();
+      for ( auto it = idx.cbegin(); it != idx.cend() && 0 < it->total_votes && it->active(); ++it ) {
+         if ( top.producers.size() == top_producers_size ) {
+            top.cutoff = it->total_votes;
+            break;
+         }
+         top.producers.push_back( producer_rank{ it->owner, it->total_votes, it->producer_key, it->location } );
       }
+      top.built = true;
    }
 
    double stake2vote( int64_t staked ) {
       /// TODO subtract 2080 brings the large numbers closer to this decade
-      double weight = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
-      return double(staked) * std::pow( 2, weight );
+      const int64_t weeks = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) );
+      return vote_weight( staked, weeks );
    }
 
    double system_contract::update_total_votepay_share( time_point ct,
@@ -124,27 +212,27 @@ namespace eosiosystem {
                                                        double shares_rate_delta )
    {
       double delta_total_votepay_share = 0.0;
-      if( ct > _gstate3.last_vpay_state_update ) {
-         delta_total_votepay_share = _gstate3.total_vpay_share_change_rate
-                                       * double( (ct - _gstate3.last_vpay_state_update).count() / 1E6 );
+      if( ct > _gstate3->last_vpay_state_update ) {
+         delta_total_votepay_share = _gstate3->total_vpay_share_change_rate
+                                       * double( (ct - _gstate3->last_vpay_state_update).count() / 1E6 );
       }
 
       delta_total_votepay_share += additional_shares_delta;
-      if( delta_total_votepay_share < 0 && _gstate2.total_producer_votepay_share < -delta_total_votepay_share ) {
-         _gstate2.total_producer_votepay_share = 0.0;
+      if( delta_total_votepay_share < 0 && _gstate2->total_producer_votepay_share < -delta_total_votepay_share ) {
+         _gstate2->total_producer_votepay_share = 0.0;
       } else {
-         _gstate2.total_producer_votepay_share += delta_total_votepay_share;
+         _gstate2->total_producer_votepay_share += delta_total_votepay_share;
       }
 
-      if( shares_rate_delta < 0 && _gstate3.total_vpay_share_change_rate < -shares_rate_delta ) {
-         _gstate3.total_vpay_share_change_rate = 0.0;
+      if( shares_rate_delta < 0 && _gstate3->total_vpay_share_change_rate < -shares_rate_delta ) {
+         _gstate3->total_vpay_share_change_rate = 0.0;
       } else {
-         _gstate3.total_vpay_share_change_rate += shares_rate_delta;
+         _gstate3->total_vpay_share_change_rate += shares_rate_delta;
       }
 
-      _gstate3.last_vpay_state_update = ct;
+      _gstate3->last_vpay_state_update = ct;
 
-      return _gstate2.total_producer_votepay_share;
+      return _gstate2->total_producer_votepay_share;
    }
 
    double system_contract::update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
@@ -218,9 +306,9 @@ namespace eosiosystem {
        * their first vote and should consider their stake activated.
        */
       // if( voter->last_vote_weight <= 0.0 ) {
-      //    _gstate.total_activated_stake += voter->staked;
-      //    if( _gstate.total_activated_stake >= min_activated_stake && _gstate.thresh_activated_stake_time == time_point() ) {
-      //       _gstate.thresh_activated_stake_time = current_time_point();
+      //    _gstate->total_activated_stake += voter->staked;
+      //    if( _gstate->total_activated_stake >= min_activated_stake && _gstate->thresh_activated_stake_time == time_point() ) {
+      //       _gstate->thresh_activated_stake_time = current_time_point();
       //    }
       // }
 
@@ -280,9 +368,10 @@ namespace eosiosystem {
                if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
                   p.total_votes = 0;
                }
-               _gstate.total_producer_vote_weight += pd.second.first;
+               _gstate->total_producer_vote_weight += pd.second.first;
                //check( p.total_votes >= 0, "something bad happened" );
             });
+            rank_producer( *pitr );
             auto prod2 = _producers2.find( pd.first.value );
             if( prod2 != _producers2.end() ) {
                const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
@@ -371,8 +460,9 @@ namespace eosiosystem {
                const double init_total_votes = prod.total_votes;
                _producers.modify( prod, same_payer, [&]( auto& p ) {
                   p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
+                  _gstate->total_producer_vote_weight += delta;
                });
+               rank_producer( prod );
                auto prod2 = _producers2.find( acnt.value );
                if ( prod2 != _producers2.end() ) {
                   const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
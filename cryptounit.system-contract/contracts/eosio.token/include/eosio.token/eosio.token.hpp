@@ -2,8 +2,26 @@
 
 #include <eosiolib/asset.hpp>
 #include <eosiolib/eosio.hpp>
+#include <eosiolib/time.hpp>
+#include <eosiolib/fixed_bytes.hpp>
+#include <eosiolib/binary_extension.hpp>
+
+#include <eosio.token/limiter_check.hpp>
+#include <eosio.token/symbol_policy.hpp>
 
 #include <string>
+#include <vector>
+
+// INPROCESS_TRANSFER_HOOKS macro determines whether transfer reads the limiter tables itself
+// and only dispatches checklimit when limiter state has to change, and whether tokenlock is told
+// about balance changes with chlbal2 instead of chlbal. checklimit is skipped only when no limit
+// applies to the transfer; a limited transfer still dispatches it, since used amounts live in the
+// limiter. chlbal2( from, from_delta, to, to_delta, mode ) carries both deltas of a transfer; issue
+// and retire send it with an empty to and a zero to_delta. The tokenlock contract is not part of
+// this repository and has to implement chlbal2 before this is turned on, so it is 0 by default.
+#ifndef INPROCESS_TRANSFER_HOOKS
+#define INPROCESS_TRANSFER_HOOKS 0
+#endif
 
 namespace eosiosystem {
    class system_contract;
@@ -49,6 +67,12 @@ namespace eosio {
          [[eosio::action]]
          void unlock( name owner );
 
+         [[eosio::action]]
+         void setsymrule( symbol_code code, uint8_t set_flags, uint8_t clear_flags );
+
+         [[eosio::action]]
+         void rmsymrule( symbol_code code );
+
          static asset get_supply( name token_contract_account, symbol_code sym_code )
          {
             stats statstable( token_contract_account, sym_code.raw() );
@@ -78,6 +102,8 @@ namespace eosio {
          using open_action = eosio::action_wrapper<"open"_n, &token::open>;
          using close_action = eosio::action_wrapper<"close"_n, &token::close>;
          using unlock_action = eosio::action_wrapper<"unlock"_n, &token::unlock>;
+         using setsymrule_action = eosio::action_wrapper<"setsymrule"_n, &token::setsymrule>;
+         using rmsymrule_action = eosio::action_wrapper<"rmsymrule"_n, &token::rmsymrule>;
 
 
       private:
@@ -101,14 +127,47 @@ namespace eosio {
             uint64_t primary_key()const { return owner.value; }
          };
 
+         // override of the symbol_policy flags of a symbol, read when SYMBOL_RULE_OVERRIDES is 1
+         struct [[eosio::table]] symrule {
+            symbol_code   code;
+            uint8_t       set_flags = 0;
+            uint8_t       clear_flags = 0;
+
+            uint64_t primary_key()const { return code.raw(); }
+         };
 
 
          typedef eosio::multi_index< "accounts"_n, account > accounts;
          typedef eosio::multi_index< "stat"_n, currency_stats > stats;
          typedef eosio::multi_index< "acclock"_n, acclock > acclocks;
+         typedef eosio::multi_index< "symrule"_n, symrule > symrules;
+
+         // read-only views of the limiter tables, the layouts are those limiter.hpp declares its tables with
+         struct limiter_rows {
+#include <eosio.token/limiter_tables.hpp>
+         };
+
+         typedef eosio::multi_index< "lock"_n, limiter_rows::lock > limiter_locks;
+         typedef eosio::multi_index< "debt"_n, limiter_rows::debt > limiter_debts;
+         typedef eosio::multi_index< "tokenlimit"_n, limiter_rows::tokenlimit > limiter_tokenlimits;
+         typedef eosio::multi_index< "whitelist"_n, limiter_rows::whitelist > limiter_whitelists;
+         typedef eosio::multi_index< "whitelistto"_n, limiter_rows::whitelistto > limiter_whiteliststo;
+         typedef eosio::multi_index< "policy"_n, limiter_rows::policy > limiter_policies;
+
+         // limiter tables as the view of limiter_state_changes in limiter_check.hpp
+         struct limiter_view;
 
          void sub_balance( name owner, asset value );
          void add_balance( name owner, asset value, name ram_payer );
+         uint8_t symbol_flags( const symbol& sym )const;
+         bool is_tokenlock_symbol( const symbol& sym )const;
+         bool limiter_state_changes( name from, name to, const asset& quantity )const;
+         void notify_tokenlock( name from, asset from_delta, name to, asset to_delta );
+         void notify_tokenlock( name account, asset delta );
+
+         // symbol_flags of the last symbol asked for in this action
+         mutable uint64_t  _flags_cache_symbol = 0;
+         mutable uint8_t   _flags_cache = 0;
    };
 
 } /// namespace eosio
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <eosio.token/symbol_policy.hpp>
+
+/**
+ *  Limit state shared by limiter::checklimit and the in-process check of eosio.token, independent of
+ *  eosiolib like symbol_policy.hpp. The limiter builds check_transfer of its transfer_check.hpp on it.
+ */
+
+enum policy_flags : uint8_t {
+   whitelisted    = 1, // transfers from the account are not limited
+   whitelisted_to = 2  // transfers to the account are not limited
+};
+
+enum limit_mode : uint8_t {
+   calendar_month = 0,  // the limit applies per calendar month
+   rolling_window = 1   // the limit applies to the last rolling_window_buckets days
+};
+
+struct limit_state {
+   int64_t limit = 0;
+   uint32_t generation = 0;
+   uint8_t mode = calendar_month;
+   bool policy_synced = false;  // every legacy row of the currency has a policy row
+};
+
+/**
+ *  Whether checklimit would change limiter state for the transfer, without writing: false where
+ *  check_transfer accepts the transfer before it touches the sender's policy row. A locked sender
+ *  without debts fails as in check_transfer. A sender on the legacy whitelist without a policy row is
+ *  accepted without the row checklimit would seed for it.
+ *
+ *  View provides, read-only:
+ *    uint8_t symbol_flags( uint64_t code )                symbol_policy flags, overrides applied
+ *    void account_state( uint64_t account, bool &is_locked, bool &has_debts )
+ *    bool find_limit( uint64_t code, limit_state &limit )  false if the currency has no limit
+ *    bool whitelisted_to( uint64_t code, uint64_t account, const limit_state &limit )
+ *    bool whitelisted( uint64_t code, uint64_t account, const limit_state &limit )
+ *    void fail( const char *msg )                          abort the transfer
+ */
+template<typename View>
+bool limiter_state_changes( View &db, uint64_t from, uint64_t to, uint64_t code )
+{
+   bool is_locked = false;
+   bool has_debts = false;
+   db.account_state( from, is_locked, has_debts );
+
+   if( has_debts ) {
+      // only checklimit can match and erase the debt
+      return true;
+   }
+   if( is_locked ) {
+      db.fail( "Account is locked" );
+      return false;
+   }
+
+   if( db.symbol_flags( code ) & symbol_policy::limit_exempt ) {
+      return false;
+   }
+
+   limit_state limit;
+   if( ! db.find_limit( code, limit ) ) {
+      return false;
+   }
+
+   if( db.whitelisted_to( code, to, limit ) ) {
+      return false;
+   }
+
+   return ! db.whitelisted( code, from, limit );
+}
@@ -0,0 +1,98 @@
+// Row layouts of the limiter tables that eosio.token reads itself under INPROCESS_TRANSFER_HOOKS.
+// Included inside a class body, hence no include guard: limiter.hpp declares its tables with it,
+// LIMITER_TABLE defined as [[eosio::table]], and eosio.token its read-only views. Types are named
+// qualified; the includer provides asset, time, fixed_bytes and binary_extension of its toolchain.
+
+#ifndef LIMITER_TABLE
+#define LIMITER_TABLE
+#define LIMITER_TABLE_DEFAULTED
+#endif
+
+   struct LIMITER_TABLE lock {
+      eosio::name account;
+      eosio::time_point_sec ts;
+      std::string note;
+
+      uint64_t primary_key() const {
+         return account.value;
+      }
+      EOSLIB_SERIALIZE(lock, (account)(ts)(note))
+   };
+
+   struct LIMITER_TABLE debt {
+      uint64_t id;
+      eosio::name target;
+      eosio::asset sum;
+      eosio::time_point_sec ts;
+      std::string memo;
+      eosio::checksum256 hash;
+      // set by setdebtexp, the debt is removed by gcdebts after it
+      eosio::binary_extension<eosio::time_point_sec> expires_at;
+
+      uint64_t primary_key() const {
+         return id;
+      }
+      eosio::checksum256 byhash() const {
+         return hash;
+      }
+      EOSLIB_SERIALIZE(debt, (id)(target)(sum)(ts)(memo)(hash)(expires_at))
+   };
+
+   struct LIMITER_TABLE tokenlimit {
+      eosio::asset month_limit;
+      eosio::time_point_sec ts;
+      // utc seconds of the last usage reset, policy rows of another generation count as unused
+      eosio::binary_extension<uint32_t> generation;
+      // limit_mode, calendar_month when absent
+      eosio::binary_extension<uint8_t> mode;
+      // set by syncpolicy once every legacy whitelist/whitelistto/usedlimit row has a policy row,
+      // checklimit then no longer probes the legacy tables for accounts without a policy row
+      eosio::binary_extension<bool> policy_synced;
+
+      uint64_t primary_key() const {
+         return month_limit.symbol.code().raw();
+      }
+      EOSLIB_SERIALIZE(tokenlimit, (month_limit)(ts)(generation)(mode)(policy_synced))
+   };
+
+   struct LIMITER_TABLE whitelist {
+      eosio::name username;
+      eosio::time_point_sec ts;
+
+      uint64_t primary_key() const {
+         return username.value;
+      }
+      EOSLIB_SERIALIZE(whitelist, (username)(ts))
+   };
+
+   struct LIMITER_TABLE whitelistto {
+      eosio::name username;
+      eosio::time_point_sec ts;
+
+      uint64_t primary_key() const {
+         return username.value;
+      }
+      EOSLIB_SERIALIZE(whitelistto, (username)(ts))
+   };
+
+   // Everything checklimit needs about an account for one currency, scoped by symbol code, flags are policy_flags.
+   // whitelist/whitelistto stay the admin-facing lists; usedlimit is superseded by used_amount.
+   struct LIMITER_TABLE policy {
+      eosio::name account;
+      uint8_t flags = 0;
+      int64_t used_amount = 0;
+      uint32_t period = 0;      // current_period of ts, used_amount counts only within it; current_bucket in rolling_window mode
+      uint32_t generation = 0;  // tokenlimit generation used_amount was counted under
+      eosio::time_point_sec ts;
+      std::vector<int64_t> window;  // rolling_window mode: ring of rolling_window_buckets used amounts, used_amount is their sum
+
+      uint64_t primary_key() const {
+         return account.value;
+      }
+      EOSLIB_SERIALIZE(policy, (account)(flags)(used_amount)(period)(generation)(ts)(window))
+   };
+
+#ifdef LIMITER_TABLE_DEFAULTED
+#undef LIMITER_TABLE
+#undef LIMITER_TABLE_DEFAULTED
+#endif
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+
+// SYMBOL_RULE_OVERRIDES macro determines whether eosio.token and limiter apply the rows of the
+// eosio.token symrule table on top of the built-in rules. Costs one table read per action, so it
+// is 0 by default.
+#ifndef SYMBOL_RULE_OVERRIDES
+#define SYMBOL_RULE_OVERRIDES 0
+#endif
+
+/**
+ *  Per-symbol rules shared by eosio.token and limiter. Independent of eosiolib, so both contract
+ *  toolchains and native checks can include it. Symbols are compared by their symbol_code raw
+ *  value; the precision is checked where a full symbol is given.
+ */
+namespace symbol_policy {
+
+   enum symbol_flags : uint8_t {
+      limit_exempt      = 1,  // limiter never limits, locks or whitelists transfers of the symbol
+      tokenlock_tracked = 2   // eosio.token reports balance changes to tokenlock
+   };
+
+   constexpr uint64_t symbol_code_raw( const char* code ) {
+      uint64_t raw = 0;
+      for( int i = 0; code[i] != 0; ++i ) {
+         raw |= uint64_t( uint8_t( code[i] ) ) << ( 8 * i );
+      }
+      return raw;
+   }
+
+   struct rule {
+      uint64_t code;       // symbol_code raw
+      uint8_t  precision;
+      uint8_t  flags;
+   };
+
+   constexpr rule rules[] = {
+      { symbol_code_raw( "CRU" ),  4, tokenlock_tracked },
+      { symbol_code_raw( "WCRU" ), 4, tokenlock_tracked },
+      { symbol_code_raw( "UNTB" ), 4, tokenlock_tracked | limit_exempt },
+      { symbol_code_raw( "USDU" ), 4, tokenlock_tracked }
+   };
+   constexpr uint32_t rule_count = sizeof( rules ) / sizeof( rules[0] );
+
+   // Lookup is a multiplicative hash into table_size slots; multiplier is searched at compile time
+   // so that the built-in codes do not collide.
+   constexpr uint32_t table_bits = 3;
+   constexpr uint32_t table_size = 1u << table_bits;
+   static_assert( rule_count <= table_size, "more rules than slots" );
+
+   constexpr uint32_t slot_of( uint64_t code, uint64_t multiplier ) {
+      return uint32_t( ( code * multiplier ) >> ( 64 - table_bits ) );
+   }
+
+   constexpr bool collision_free( uint64_t multiplier ) {
+      for( uint32_t i = 0; i < rule_count; ++i ) {
+         for( uint32_t j = i + 1; j < rule_count; ++j ) {
+            if( slot_of( rules[i].code, multiplier ) == slot_of( rules[j].code, multiplier ) ) {
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   constexpr uint64_t find_multiplier() {
+      for( uint64_t m = 0x9E3779B97F4A7C15ull, i = 0; i < 4096; m += 2, ++i ) {
+         if( collision_free( m ) ) {
+            return m;
+         }
+      }
+      return 0;
+   }
+
+   constexpr uint64_t multiplier = find_multiplier();
+   static_assert( multiplier != 0, "no collision free multiplier for the symbol rules" );
+
+   struct table {
+      rule slots[table_size] = {};
+   };
+
+   constexpr table build_table() {
+      table t;
+      for( uint32_t i = 0; i < rule_count; ++i ) {
+         t.slots[ slot_of( rules[i].code, multiplier ) ] = rules[i];
+      }
+      return t;
+   }
+
+   constexpr table lookup_table = build_table();
+
+   /// Built-in rule of a symbol code, nullptr when the symbol has none
+   constexpr const rule* find( uint64_t code ) {
+      const rule& r = lookup_table.slots[ slot_of( code, multiplier ) ];
+      return r.code == code && code != 0 ? &r : nullptr;
+   }
+
+   /// Built-in flags of a symbol code
+   constexpr uint8_t flags_of( uint64_t code ) {
+      const rule* r = find( code );
+      return r != nullptr ? r->flags : 0;
+   }
+
+   /// Built-in flags of a full symbol, symbol_code raw << 8 | precision
+   constexpr uint8_t flags_of_symbol( uint64_t symbol_raw ) {
+      const rule* r = find( symbol_raw >> 8 );
+      return r != nullptr && r->precision == uint8_t( symbol_raw ) ? r->flags : 0;
+   }
+
+   static_assert( flags_of( symbol_code_raw( "UNTB" ) ) == ( tokenlock_tracked | limit_exempt ), "UNTB" );
+   static_assert( flags_of( symbol_code_raw( "CRU" ) ) == tokenlock_tracked, "CRU" );
+   static_assert( flags_of( symbol_code_raw( "WCRU" ) ) == tokenlock_tracked, "WCRU" );
+   static_assert( flags_of( symbol_code_raw( "USDU" ) ) == tokenlock_tracked, "USDU" );
+   static_assert( flags_of( symbol_code_raw( "EOS" ) ) == 0, "symbol without rule" );
+   static_assert( flags_of_symbol( symbol_code_raw( "CRU" ) << 8 | 4 ) == tokenlock_tracked, "CRU,4" );
+   static_assert( flags_of_symbol( symbol_code_raw( "CRU" ) << 8 | 8 ) == 0, "CRU,8" );
+
+} /// namespace symbol_policy
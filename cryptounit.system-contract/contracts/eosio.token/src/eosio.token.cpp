@@ -53,12 +53,7 @@ void token::issue( name to, asset quantity, string memo )
                           { st.issuer, to, quantity, memo }
       );
     } else {
-      action(
-        permission_level{_self,"active"_n},
-        _tokenlock,
-        name("chlbal"),
-        std::make_tuple(st.issuer, quantity, uint64_t(0))
-      ).send();
+      notify_tokenlock( st.issuer, quantity );
     }
 }
 
@@ -85,13 +80,8 @@ void token::retire( name username, asset quantity, string memo )
 
     sub_balance( username, quantity );
 
-    if ((quantity.symbol == _cru_symbol) || (quantity.symbol == _wcru_symbol) || (quantity.symbol == _untb_symbol) || (quantity.symbol == _usdu_symbol) ){
-        action(
-          permission_level{_self,"active"_n},
-          _tokenlock,
-          name("chlbal"),
-          std::make_tuple(username, - quantity, uint64_t(0))
-        ).send(); 
+    if( is_tokenlock_symbol( quantity.symbol ) ){
+        notify_tokenlock( username, - quantity );
     }
 }
 
@@ -104,6 +94,9 @@ void token::transfer( name    from,
     require_auth( from );
     check( is_account( to ), "to account does not exist");
 
+#if INPROCESS_TRANSFER_HOOKS
+    if( limiter_state_changes( from, to, quantity ) )
+#endif
     action(
     	permission_level{_self,"active"_n},
 		_limiter,
@@ -128,29 +121,162 @@ void token::transfer( name    from,
     sub_balance( from, quantity );
     add_balance( to, quantity, payer );
     
-    if ((quantity.symbol == _cru_symbol) || (quantity.symbol == _wcru_symbol) || (quantity.symbol == _untb_symbol) || (quantity.symbol == _usdu_symbol) ){
-        action(
-          permission_level{_self,"active"_n},
-          _tokenlock,
-          name("chlbal"),
-          std::make_tuple(to, quantity, uint64_t(0))
-        ).send(); 
-      
-      stats statstable( _self, quantity.symbol.code().raw() );
-      auto existing = statstable.find( quantity.symbol.code().raw() );
-      // const auto& st = *existing;
-
-      if (from != existing -> issuer)
-        action(
-          permission_level{_self,"active"_n},
-          _tokenlock,
-          name("chlbal"),
-          std::make_tuple(from, -quantity, uint64_t(0))
-        ).send(); 
-       
+    if( is_tokenlock_symbol( quantity.symbol ) ) {
+      // issuer balance is not tracked by tokenlock
+      asset from_delta = from != st.issuer ? -quantity : asset( 0, quantity.symbol );
+      notify_tokenlock( from, from_delta, to, quantity );
     }
 }
 
+// symbol_policy flags of a symbol, with the symrule override applied when enabled
+uint8_t token::symbol_flags( const symbol& sym )const {
+    if( sym.raw() == _flags_cache_symbol ) {
+      return _flags_cache;
+    }
+    uint8_t flags = symbol_policy::flags_of_symbol( sym.raw() );
+#if SYMBOL_RULE_OVERRIDES
+    symrules rules( _self, _self.value );
+    auto it = rules.find( sym.code().raw() );
+    if( it != rules.end() ) {
+      flags = ( flags | it->set_flags ) & ~it->clear_flags;
+    }
+#endif
+    _flags_cache_symbol = sym.raw();
+    _flags_cache = flags;
+    return flags;
+}
+
+bool token::is_tokenlock_symbol( const symbol& sym )const {
+    return ( symbol_flags( sym ) & symbol_policy::tokenlock_tracked ) != 0;
+}
+
+void token::setsymrule( symbol_code code, uint8_t set_flags, uint8_t clear_flags )
+{
+    require_auth( _self );
+    check( code.is_valid(), "invalid symbol name" );
+    check( ( set_flags & clear_flags ) == 0, "flag both set and cleared" );
+
+    symrules rules( _self, _self.value );
+    auto it = rules.find( code.raw() );
+    if( it == rules.end() ) {
+      rules.emplace( _self, [&]( auto& r ) {
+        r.code = code;
+        r.set_flags = set_flags;
+        r.clear_flags = clear_flags;
+      });
+    } else {
+      rules.modify( it, same_payer, [&]( auto& r ) {
+        r.set_flags = set_flags;
+        r.clear_flags = clear_flags;
+      });
+    }
+}
+
+void token::rmsymrule( symbol_code code )
+{
+    require_auth( _self );
+
+    symrules rules( _self, _self.value );
+    const auto& it = rules.get( code.raw(), "symbol rule not found" );
+    rules.erase( it );
+}
+
+void token::notify_tokenlock( name from, asset from_delta, name to, asset to_delta ) {
+#if INPROCESS_TRANSFER_HOOKS
+    action(
+      permission_level{_self,"active"_n},
+      _tokenlock,
+      name("chlbal2"),
+      std::make_tuple(from, from_delta, to, to_delta, uint64_t(0))
+    ).send();
+#else
+    notify_tokenlock( to, to_delta );
+
+    if( from_delta.amount != 0 )
+      notify_tokenlock( from, from_delta );
+#endif
+}
+
+void token::notify_tokenlock( name account, asset delta ) {
+#if INPROCESS_TRANSFER_HOOKS
+    // issue and retire change a single balance; the second leg is empty
+    notify_tokenlock( account, delta, name(), asset( 0, delta.symbol ) );
+#else
+    action(
+      permission_level{_self,"active"_n},
+      _tokenlock,
+      name("chlbal"),
+      std::make_tuple(account, delta, uint64_t(0))
+    ).send();
+#endif
+}
+
+struct token::limiter_view {
+    const token&   self;
+    const symbol&  sym;
+
+    uint8_t symbol_flags( uint64_t )const {
+      return self.symbol_flags( sym );
+    }
+
+    void account_state( uint64_t account, bool& is_locked, bool& has_debts )const {
+      limiter_debts debts( _limiter, account );
+      has_debts = debts.begin() != debts.end();
+      limiter_locks locks( _limiter, _limiter.value );
+      is_locked = locks.find( account ) != locks.end();
+    }
+
+    bool find_limit( uint64_t code, limit_state& limit )const {
+      limiter_tokenlimits limits( _limiter, _limiter.value );
+      auto token_limit = limits.find( code );
+      if( token_limit == limits.end() ) {
+        return false;
+      }
+      limit.limit = token_limit->month_limit.amount;
+      limit.generation = token_limit->generation.value_or( 0 );
+      limit.mode = token_limit->mode.value_or( calendar_month );
+      limit.policy_synced = token_limit->policy_synced.value_or( false );
+      return true;
+    }
+
+    bool whitelisted_to( uint64_t code, uint64_t account, const limit_state& limit )const {
+      limiter_policies policies( _limiter, code );
+      auto it = policies.find( account );
+      if( it != policies.end() ) {
+        return ( it->flags & ::whitelisted_to ) != 0;
+      }
+      if( limit.policy_synced ) {
+        return false;
+      }
+      limiter_whiteliststo whiteliststo( _limiter, code );
+      return whiteliststo.find( account ) != whiteliststo.end();
+    }
+
+    bool whitelisted( uint64_t code, uint64_t account, const limit_state& limit )const {
+      limiter_policies policies( _limiter, code );
+      auto it = policies.find( account );
+      if( it != policies.end() ) {
+        return ( it->flags & ::whitelisted ) != 0;
+      }
+      if( limit.policy_synced ) {
+        return false;
+      }
+      limiter_whitelists whitelists( _limiter, code );
+      return whitelists.find( account ) != whitelists.end();
+    }
+
+    void fail( const char* msg )const {
+      check( false, msg );
+    }
+};
+
+// Returns false when checklimit would accept the transfer without touching limiter state, so the
+// inline action can be skipped. Same decision as limiter::checklimit, see limiter_check.hpp.
+bool token::limiter_state_changes( name from, name to, const asset& quantity )const {
+    limiter_view view{ *this, quantity.symbol };
+    return ::limiter_state_changes( view, from.value, to.value, quantity.symbol.code().raw() );
+}
+
 void token::sub_balance( name owner, asset value ) {
    accounts from_acnts( _self, owner.value );
 
@@ -219,4 +345,4 @@ void token::unlock( name owner )
 
 } /// namespace eosio
 
-EOSIO_DISPATCH( eosio::token, (create)(issue)(transfer)(open)(close)(retire)(unlock) )
+EOSIO_DISPATCH( eosio::token, (create)(issue)(transfer)(open)(close)(retire)(unlock)(setsymrule)(rmsymrule) )
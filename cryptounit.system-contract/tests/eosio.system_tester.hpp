@@ -745,6 +745,33 @@ public:
       return abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time );
    }
 
+   // producer_info::unpaid_blocks plus the blocks counted in unpaidblks since the last flush
+   uint32_t get_unpaid_blocks( const account_name& act ) {
+      uint32_t unpaid_blocks = get_producer_info( act )["unpaid_blocks"].as<uint32_t>();
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(unpaidblks), N(unpaidblks) );
+      if( !data.empty() ) {
+         const auto state = abi_ser.binary_to_variant( "unpaid_blocks_state", data, abi_serializer_max_time );
+         for( const auto& e : state["producers"].get_array() ) {
+            if( e["producer"].as<account_name>() == act )
+               unpaid_blocks += e["unpaid_blocks"].as<uint32_t>();
+         }
+      }
+      return unpaid_blocks;
+   }
+
+   // the global total_unpaid_blocks plus the blocks counted in unpaidblks since the last flush
+   uint32_t get_total_unpaid_blocks() {
+      uint32_t unpaid_blocks = get_global_state()["total_unpaid_blocks"].as<uint32_t>();
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(unpaidblks), N(unpaidblks) );
+      if( !data.empty() ) {
+         const auto state = abi_ser.binary_to_variant( "unpaid_blocks_state", data, abi_serializer_max_time );
+         for( const auto& e : state["producers"].get_array() ) {
+            unpaid_blocks += e["unpaid_blocks"].as<uint32_t>();
+         }
+      }
+      return unpaid_blocks;
+   }
+
    fc::variant get_producer_info2( const account_name& act ) {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), act );
       return abi_ser.binary_to_variant( "producer_info2", data, abi_serializer_max_time );
@@ -814,6 +841,16 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state3", data, abi_serializer_max_time );
    }
 
+   fc::variant get_global_state4() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global4), N(global4) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state4", data, abi_serializer_max_time );
+   }
+
+   fc::variant get_global_state5() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global5), N(global5) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state5", data, abi_serializer_max_time );
+   }
+
    fc::variant get_refund_request( name account ) {
       vector<char> data = get_row_by_account( config::system_account_name, account, N(refunds), account );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "refund_request", data, abi_serializer_max_time );
@@ -46,19 +46,19 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( true, 0 < bought_bytes );
 
    BOOST_REQUIRE_EQUAL( success(), sellram( "alice1111111", bought_bytes ) );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("998.0049"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("998.0047"), get_balance( "alice1111111" ) );
    total = get_total_stake( "alice1111111" );
    BOOST_REQUIRE_EQUAL( true, total["ram_bytes"].as_uint64() == init_bytes );
 
    transfer( "eosio", "alice1111111", core_sym::from_string("100000000.0000"), "eosio" );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("100000998.0049"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("100000998.0047"), get_balance( "alice1111111" ) );
    // alice buys ram for 10000000.0000, 0.5% = 50000.0000 go to ramfee
    // after fee 9950000.0000 go to bought bytes
    // when selling back bought bytes, pay 0.5% fee and get back 99.5% of 9950000.0000 = 9900250.0000
-   // expected account after that is 90000998.0049 + 9900250.0000 = 99901248.0049 with a difference
+   // expected account after that is 90000998.0047 + 9900250.0000 = 99901248.0047 with a difference
    // of order 0.0001 due to rounding errors
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("10000000.0000") ) );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("90000998.0049"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("90000998.0047"), get_balance( "alice1111111" ) );
 
    total = get_total_stake( "alice1111111" );
    bytes = total["ram_bytes"].as_uint64();
@@ -73,7 +73,7 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    wdump((init_bytes)(bought_bytes)(bytes) );
 
    BOOST_REQUIRE_EQUAL( true, total["ram_bytes"].as_uint64() == init_bytes );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("99901248.0048"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("99901248.0046"), get_balance( "alice1111111" ) );
 
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100.0000") ) );
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100.0000") ) );
@@ -84,7 +84,7 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("10.0000") ) );
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("10.0000") ) );
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("30.0000") ) );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("99900688.0048"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("99900688.0046"), get_balance( "alice1111111" ) );
 
    auto newtotal = get_total_stake( "alice1111111" );
 
@@ -93,7 +93,7 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    wdump((newbytes)(bytes)(bought_bytes) );
 
    BOOST_REQUIRE_EQUAL( success(), sellram( "alice1111111", bought_bytes ) );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("99901242.4187"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("99901242.4174"), get_balance( "alice1111111" ) );
 
    newtotal = get_total_stake( "alice1111111" );
    auto startbytes = newtotal["ram_bytes"].as_uint64();
@@ -107,7 +107,7 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100000.0000") ) );
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100000.0000") ) );
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("300000.0000") ) );
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("49301242.4187"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("49301242.4174"), get_balance( "alice1111111" ) );
 
    auto finaltotal = get_total_stake( "alice1111111" );
    auto endbytes = finaltotal["ram_bytes"].as_uint64();
@@ -117,7 +117,7 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
 
    BOOST_REQUIRE_EQUAL( success(), sellram( "alice1111111", bought_bytes ) );
 
-   BOOST_REQUIRE_EQUAL( core_sym::from_string("99396507.4158"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("99396507.4122"), get_balance( "alice1111111" ) );
 
 } FC_LOG_AND_RETHROW()
 
@@ -1225,10 +1225,10 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_total_unpaid_blocks();
 
       prod = get_producer_info("defproducera");
-      const uint32_t unpaid_blocks = prod["unpaid_blocks"].as<uint32_t>();
+      const uint32_t unpaid_blocks = get_unpaid_blocks("defproducera");
       BOOST_REQUIRE(1 < unpaid_blocks);
 
       BOOST_REQUIRE_EQUAL(initial_tot_unpaid_blocks, unpaid_blocks);
@@ -1243,10 +1243,10 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_total_unpaid_blocks();
 
       prod = get_producer_info("defproducera");
-      BOOST_REQUIRE_EQUAL(1, prod["unpaid_blocks"].as<uint32_t>());
+      BOOST_REQUIRE_EQUAL(1, get_unpaid_blocks("defproducera"));
       BOOST_REQUIRE_EQUAL(1, tot_unpaid_blocks);
       const asset supply  = get_token_supply();
       const asset balance = get_balance(N(defproducera));
@@ -1301,11 +1301,11 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_total_unpaid_blocks();
       const double   initial_tot_vote_weight   = initial_global_state["total_producer_vote_weight"].as<double>();
 
       prod = get_producer_info("defproducera");
-      const uint32_t unpaid_blocks = prod["unpaid_blocks"].as<uint32_t>();
+      const uint32_t unpaid_blocks = get_unpaid_blocks("defproducera");
       BOOST_REQUIRE(1 < unpaid_blocks);
       BOOST_REQUIRE_EQUAL(initial_tot_unpaid_blocks, unpaid_blocks);
       BOOST_REQUIRE(0 < prod["total_votes"].as<double>());
@@ -1324,10 +1324,10 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_total_unpaid_blocks();
 
       prod = get_producer_info("defproducera");
-      BOOST_REQUIRE_EQUAL(1, prod["unpaid_blocks"].as<uint32_t>());
+      BOOST_REQUIRE_EQUAL(1, get_unpaid_blocks("defproducera"));
       BOOST_REQUIRE_EQUAL(1, tot_unpaid_blocks);
       const asset supply  = get_token_supply();
       const asset balance = get_balance(N(defproducera));
@@ -1464,13 +1464,13 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       produce_blocks(23 * 12 + 20);
       bool all_21_produced = true;
       for (uint32_t i = 0; i < 21; ++i) {
-         if (0 == get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 == get_unpaid_blocks(producer_names[i])) {
             all_21_produced = false;
          }
       }
       bool rest_didnt_produce = true;
       for (uint32_t i = 21; i < producer_names.size(); ++i) {
-         if (0 < get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 < get_unpaid_blocks(producer_names[i])) {
             rest_didnt_produce = false;
          }
       }
@@ -1501,12 +1501,12 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_total_unpaid_blocks();
       const asset    initial_supply            = get_token_supply();
       const asset    initial_bpay_balance      = get_balance(N(eosio.bpay));
       const asset    initial_vpay_balance      = get_balance(N(eosio.vpay));
       const asset    initial_balance           = get_balance(prod_name);
-      const uint32_t initial_unpaid_blocks     = get_producer_info(prod_name)["unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_unpaid_blocks     = get_unpaid_blocks(prod_name);
 
       BOOST_REQUIRE_EQUAL(success(), push_action(prod_name, N(claimrewards), mvo()("owner", prod_name)));
 
@@ -1515,12 +1515,12 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_total_unpaid_blocks();
       const asset    supply            = get_token_supply();
       const asset    bpay_balance      = get_balance(N(eosio.bpay));
       const asset    vpay_balance      = get_balance(N(eosio.vpay));
       const asset    balance           = get_balance(prod_name);
-      const uint32_t unpaid_blocks     = get_producer_info(prod_name)["unpaid_blocks"].as<uint32_t>();
+      const uint32_t unpaid_blocks     = get_unpaid_blocks(prod_name);
 
       const uint64_t usecs_between_fills = claim_time - initial_claim_time;
       const int32_t secs_between_fills = static_cast<int32_t>(usecs_between_fills / 1000000);
@@ -1577,12 +1577,12 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
       const int64_t  initial_savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_total_unpaid_blocks();
       const asset    initial_supply            = get_token_supply();
       const asset    initial_bpay_balance      = get_balance(N(eosio.bpay));
       const asset    initial_vpay_balance      = get_balance(N(eosio.vpay));
       const asset    initial_balance           = get_balance(prod_name);
-      const uint32_t initial_unpaid_blocks     = get_producer_info(prod_name)["unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_unpaid_blocks     = get_unpaid_blocks(prod_name);
 
       BOOST_REQUIRE_EQUAL(success(), push_action(prod_name, N(claimrewards), mvo()("owner", prod_name)));
 
@@ -1591,12 +1591,12 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
       const int64_t  savings           = get_balance(N(eosio.saving)).get_amount();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_total_unpaid_blocks();
       const asset    supply            = get_token_supply();
       const asset    bpay_balance      = get_balance(N(eosio.bpay));
       const asset    vpay_balance      = get_balance(N(eosio.vpay));
       const asset    balance           = get_balance(prod_name);
-      const uint32_t unpaid_blocks     = get_producer_info(prod_name)["unpaid_blocks"].as<uint32_t>();
+      const uint32_t unpaid_blocks     = get_unpaid_blocks(prod_name);
 
       const uint64_t usecs_between_fills = claim_time - initial_claim_time;
 
@@ -1656,7 +1656,7 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       {
          bool rest_didnt_produce = true;
          for (uint32_t i = 21; i < producer_names.size(); ++i) {
-            if (0 < get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+            if (0 < get_unpaid_blocks(producer_names[i])) {
                rest_didnt_produce = false;
             }
          }
@@ -1665,17 +1665,17 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
 
       produce_blocks(3 * 21 * 12);
       info = get_producer_info(prod_name);
-      const uint32_t init_unpaid_blocks = info["unpaid_blocks"].as<uint32_t>();
+      const uint32_t init_unpaid_blocks = get_unpaid_blocks(prod_name);
       BOOST_REQUIRE( !info["is_active"].as<bool>() );
       BOOST_REQUIRE( fc::crypto::public_key() == fc::crypto::public_key(info["producer_key"].as_string()) );
       BOOST_REQUIRE_EQUAL( wasm_assert_msg("producer does not have an active key"),
                            push_action(prod_name, N(claimrewards), mvo()("owner", prod_name) ) );
       produce_blocks(3 * 21 * 12);
-      BOOST_REQUIRE_EQUAL( init_unpaid_blocks, get_producer_info(prod_name)["unpaid_blocks"].as<uint32_t>() );
+      BOOST_REQUIRE_EQUAL( init_unpaid_blocks, get_unpaid_blocks(prod_name) );
       {
          bool prod_was_replaced = false;
          for (uint32_t i = 21; i < producer_names.size(); ++i) {
-            if (0 < get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+            if (0 < get_unpaid_blocks(producer_names[i])) {
                prod_was_replaced = true;
             }
          }
@@ -1711,10 +1711,10 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const uint64_t initial_bucket_fill_time  = microseconds_since_epoch_of_iso_string( initial_global_state["last_pervote_bucket_fill"] );
       const int64_t  initial_pervote_bucket    = initial_global_state["pervote_bucket"].as<int64_t>();
       const int64_t  initial_perblock_bucket   = initial_global_state["perblock_bucket"].as<int64_t>();
-      const uint32_t initial_tot_unpaid_blocks = initial_global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_tot_unpaid_blocks = get_total_unpaid_blocks();
       const asset    initial_supply            = get_token_supply();
       const asset    initial_balance           = get_balance(prod_name);
-      const uint32_t initial_unpaid_blocks     = initial_prod_info["unpaid_blocks"].as<uint32_t>();
+      const uint32_t initial_unpaid_blocks     = get_unpaid_blocks(prod_name);
       const uint64_t initial_claim_time        = microseconds_since_epoch_of_iso_string( initial_prod_info["last_claim_time"] );
       const uint64_t initial_prod_update_time  = microseconds_since_epoch_of_iso_string( initial_prod_info2["last_votepay_share_update"] );
 
@@ -1728,10 +1728,10 @@ BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::uni
       const uint64_t bucket_fill_time  = microseconds_since_epoch_of_iso_string( global_state["last_pervote_bucket_fill"] );
       const int64_t  pervote_bucket    = global_state["pervote_bucket"].as<int64_t>();
       const int64_t  perblock_bucket   = global_state["perblock_bucket"].as<int64_t>();
-      const uint32_t tot_unpaid_blocks = global_state["total_unpaid_blocks"].as<uint32_t>();
+      const uint32_t tot_unpaid_blocks = get_total_unpaid_blocks();
       const asset    supply            = get_token_supply();
       const asset    balance           = get_balance(prod_name);
-      const uint32_t unpaid_blocks     = prod_info["unpaid_blocks"].as<uint32_t>();
+      const uint32_t unpaid_blocks     = get_unpaid_blocks(prod_name);
       const uint64_t claim_time        = microseconds_since_epoch_of_iso_string( prod_info["last_claim_time"] );
       const uint64_t prod_update_time  = microseconds_since_epoch_of_iso_string( prod_info2["last_votepay_share_update"] );
 
@@ -2492,13 +2492,13 @@ BOOST_FIXTURE_TEST_CASE(producer_onblock_check, eosio_system_tester) try {
       produce_blocks(21 * 12);
       bool all_21_produced = true;
       for (uint32_t i = 0; i < 21; ++i) {
-         if (0 == get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 == get_unpaid_blocks(producer_names[i])) {
             all_21_produced= false;
          }
       }
       bool rest_didnt_produce = true;
       for (uint32_t i = 21; i < producer_names.size(); ++i) {
-         if (0 < get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 < get_unpaid_blocks(producer_names[i])) {
             rest_didnt_produce = false;
          }
       }
@@ -2508,7 +2508,7 @@ BOOST_FIXTURE_TEST_CASE(producer_onblock_check, eosio_system_tester) try {
 
    {
       const char* claimrewards_activation_error_message = "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)";
-      BOOST_CHECK_EQUAL(0, get_global_state()["total_unpaid_blocks"].as<uint32_t>());
+      BOOST_CHECK_EQUAL(0, get_total_unpaid_blocks());
       BOOST_REQUIRE_EQUAL(wasm_assert_msg( claimrewards_activation_error_message ),
                           push_action(producer_names.front(), N(claimrewards), mvo()("owner", producer_names.front())));
       BOOST_REQUIRE_EQUAL(0, get_balance(producer_names.front()).get_amount());
@@ -2531,13 +2531,13 @@ BOOST_FIXTURE_TEST_CASE(producer_onblock_check, eosio_system_tester) try {
       produce_blocks(21 * 12);
       bool all_21_produced = true;
       for (uint32_t i = 0; i < 21; ++i) {
-         if (0 == get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 == get_unpaid_blocks(producer_names[i])) {
             all_21_produced= false;
          }
       }
       bool rest_didnt_produce = true;
       for (uint32_t i = 21; i < producer_names.size(); ++i) {
-         if (0 < get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 < get_unpaid_blocks(producer_names[i])) {
             rest_didnt_produce = false;
          }
       }
@@ -2843,6 +2843,37 @@ BOOST_FIXTURE_TEST_CASE( elect_producers /*_and_parameters*/, eosio_system_teste
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( schedule_change_while_proposal_waits, eosio_system_tester ) try {
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2), N(defproducer3), N(defproducer4), N(defproducer5) } );
+   for( uint16_t i = 1; i <= 5; ++i ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( name( "defproducer" + std::to_string(i) ), i ) );
+   }
+
+   transfer( "eosio", "alice1111111", core_sym::from_string("600000000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", "alice1111111", core_sym::from_string("300000000.0000"), core_sym::from_string("300000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1), N(defproducer2), N(defproducer3) } ) );
+   produce_blocks(250);
+   BOOST_REQUIRE_EQUAL( 3, control->head_block_state()->active_schedule.producers.size() );
+
+   // the next update_elected_producers proposes 4 producers, the proposal is not irreversible a block later
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1), N(defproducer2), N(defproducer3), N(defproducer4) } ) );
+   produce_block( fc::seconds(61) );
+   BOOST_REQUIRE( control->proposed_producers().valid() );
+   BOOST_REQUIRE_EQUAL( 4, control->proposed_producers()->producers.size() );
+
+   // set_proposed_producers refuses a 5 producer schedule while the 4 producer one waits
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1), N(defproducer2), N(defproducer3), N(defproducer4), N(defproducer5) } ) );
+   produce_block( fc::seconds(61) );
+   BOOST_REQUIRE_EQUAL( 4, control->proposed_producers()->producers.size() );
+
+   // once the 4 producer schedule is in, the 5 producer one is proposed although the votes did not change since
+   produce_blocks(500);
+   const auto producer_keys = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 5, producer_keys.size() );
+   BOOST_REQUIRE_EQUAL( name("defproducer5"), producer_keys[4].producer_name );
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( buyname, eosio_system_tester ) try {
    create_accounts_with_resources( { N(dan), N(sam) } );
    transfer( config::system_account_name, "dan", core_sym::from_string( "10000.0000" ) );
@@ -2970,7 +3001,7 @@ BOOST_FIXTURE_TEST_CASE( multiple_namebids, eosio_system_tester ) try {
 
    // stake enough to go above the 15% threshold
    stake_with_transfer( config::system_account_name, "alice", core_sym::from_string( "10000000.0000" ), core_sym::from_string( "10000000.0000" ) );
-   BOOST_REQUIRE_EQUAL(0, get_producer_info("producer")["unpaid_blocks"].as<uint32_t>());
+   BOOST_REQUIRE_EQUAL(0, get_unpaid_blocks("producer"));
    BOOST_REQUIRE_EQUAL( success(), vote( N(alice), { N(producer) } ) );
 
    // need to wait for 14 days after going live
@@ -3093,13 +3124,13 @@ BOOST_FIXTURE_TEST_CASE( vote_producers_in_and_out, eosio_system_tester ) try {
       produce_blocks(23 * 12 + 20);
       bool all_21_produced = true;
       for (uint32_t i = 0; i < 21; ++i) {
-         if (0 == get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 == get_unpaid_blocks(producer_names[i])) {
             all_21_produced = false;
          }
       }
       bool rest_didnt_produce = true;
       for (uint32_t i = 21; i < producer_names.size(); ++i) {
-         if (0 < get_producer_info(producer_names[i])["unpaid_blocks"].as<uint32_t>()) {
+         if (0 < get_unpaid_blocks(producer_names[i])) {
             rest_didnt_produce = false;
          }
       }
@@ -3112,12 +3143,12 @@ BOOST_FIXTURE_TEST_CASE( vote_producers_in_and_out, eosio_system_tester ) try {
       const uint32_t new_prod_index  = 23;
       BOOST_REQUIRE_EQUAL(success(), stake("producvoterd", core_sym::from_string("40000000.0000"), core_sym::from_string("40000000.0000")));
       BOOST_REQUIRE_EQUAL(success(), vote(N(producvoterd), { producer_names[new_prod_index] }));
-      BOOST_REQUIRE_EQUAL(0, get_producer_info(producer_names[new_prod_index])["unpaid_blocks"].as<uint32_t>());
+      BOOST_REQUIRE_EQUAL(0, get_unpaid_blocks(producer_names[new_prod_index]));
       produce_blocks(4 * 12 * 21);
-      BOOST_REQUIRE(0 < get_producer_info(producer_names[new_prod_index])["unpaid_blocks"].as<uint32_t>());
-      const uint32_t initial_unpaid_blocks = get_producer_info(producer_names[voted_out_index])["unpaid_blocks"].as<uint32_t>();
+      BOOST_REQUIRE(0 < get_unpaid_blocks(producer_names[new_prod_index]));
+      const uint32_t initial_unpaid_blocks = get_unpaid_blocks(producer_names[voted_out_index]);
       produce_blocks(2 * 12 * 21);
-      BOOST_REQUIRE_EQUAL(initial_unpaid_blocks, get_producer_info(producer_names[voted_out_index])["unpaid_blocks"].as<uint32_t>());
+      BOOST_REQUIRE_EQUAL(initial_unpaid_blocks, get_unpaid_blocks(producer_names[voted_out_index]));
       produce_block(fc::hours(24));
       BOOST_REQUIRE_EQUAL(success(), vote(N(producvoterd), { producer_names[voted_out_index] }));
       produce_blocks(2 * 12 * 21);
@@ -3236,9 +3267,9 @@ BOOST_FIXTURE_TEST_CASE( setram_effect, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance(name_a) );
       const uint64_t bought_bytes_a = get_total_stake(name_a)["ram_bytes"].as_uint64() - init_bytes_a;
 
-      // after buying and selling balance should be 700 + 300 * 0.995 * 0.995 = 997.0075 (actually 997.0074 due to rounding fees up)
+      // after buying and selling balance should be 700 + 300 * 0.995 * 0.995 = 997.0075 (actually 997.0073 due to rounding fees up and down)
       BOOST_REQUIRE_EQUAL( success(), sellram(name_a, bought_bytes_a ) );
-      BOOST_REQUIRE_EQUAL( core_sym::from_string("997.0074"), get_balance(name_a) );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string("997.0073"), get_balance(name_a) );
    }
 
    {
@@ -5117,4 +5148,739 @@ BOOST_FIXTURE_TEST_CASE( buy_pin_sell_ram, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+// Staker actions on a chain whose core token is the staker reward symbol, UNTB.
+class eosio_staker_tester : public eosio_system_tester {
+public:
+
+   eosio_staker_tester() : eosio_system_tester( setup_level::minimal ) {
+      // created before the system contract, unlimited resources like the eosio.* accounts.
+      // tokenlock and limiter are notified by eosio.token, cryptounit receives the owner bucket
+      create_accounts( { N(tokenlock), N(limiter), N(cryptounit), N(staker1), N(staker2), N(staker3), N(staker4) } );
+      create_currency( N(eosio.token), config::system_account_name, asset::from_string("10000000000.0000 UNTB") );
+      issue( config::system_account_name, asset::from_string("1000000000.0000 UNTB") );
+
+      deploy_contract( false );
+      base_tester::push_action( config::system_account_name, N(init), config::system_account_name, mvo()
+                                ("version", 0)
+                                ("core", "4,UNTB")
+      );
+      produce_blocks();
+   }
+
+   action_result activate_emission( uint64_t emission_step_in_sec ) {
+      activated_at = time_point( time_point_sec( control->head_block_time() ) );
+      step_usecs = emission_step_in_sec * 1000000;
+      return push_action( config::system_account_name, N(activate), mvo()
+                          ("activate_at", time_point_sec( activated_at ))
+                          ("emission_step_in_sec", emission_step_in_sec)
+      );
+   }
+
+   action_result frstake( const account_name& username, const asset& quantity ) {
+      return push_action( N(tokenlock), N(frstake), mvo()("username", username)("quantity", quantity) );
+   }
+
+   action_result frunstake( const account_name& username, const asset& quantity ) {
+      return push_action( N(tokenlock), N(frunstake), mvo()("username", username)("quantity", quantity) );
+   }
+
+   action_result refresh( const account_name& username ) {
+      return push_action( username, N(refresh), mvo()("username", username) );
+   }
+
+   action_result refreshmany( const std::vector<account_name>& usernames ) {
+      return push_action( usernames.front(), N(refreshmany), mvo()("usernames", usernames) );
+   }
+
+   action_result refreshcrank( uint16_t max_rows ) {
+      return push_action( N(staker4), N(refreshcrank), mvo()("max_rows", max_rows) );
+   }
+
+   action_result getreward( const account_name& username, const asset& to_withdraw ) {
+      return push_action( username, N(getreward), mvo()("username", username)("to_withdraw", to_withdraw) );
+   }
+
+   action_result migratestkr( uint32_t max_rows ) {
+      return push_action( config::system_account_name, N(migratestkr), mvo()("max_rows", max_rows) );
+   }
+
+   fc::variant get_staker( const account_name& username ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(stakerv2), username );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "staker_v2", data, abi_serializer_max_time );
+   }
+
+   int64_t emitted_of( const account_name& username ) {
+      return get_staker( username )["emitted"].as<int64_t>();
+   }
+
+   bool has_legacy_row( name table, const account_name& username ) {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, table, username ).empty();
+   }
+
+   // Writes chain state on every node of the tester, standing in for the rows the contract left behind
+   // before stakerv2
+   template<typename Write>
+   void write_state( Write&& write ) {
+      write( control->mutable_db() );
+#ifndef NON_VALIDATING_TEST
+      write( validating_node->mutable_db() );
+#endif
+   }
+
+   static const table_id_object& eosio_table( chainbase::database& db, name table ) {
+      const auto* t_id = db.find<table_id_object, by_code_scope_table>(
+         boost::make_tuple( config::system_account_name, config::system_account_name, table ) );
+      if( t_id == nullptr ) {
+         t_id = &db.create<table_id_object>( [&]( auto& t ) {
+            t.code  = config::system_account_name;
+            t.scope = config::system_account_name;
+            t.table = table;
+            t.payer = config::system_account_name;
+         });
+      }
+      return *t_id;
+   }
+
+   void set_eosio_row( name table, uint64_t primary_key, const string& type, const fc::variant& row ) {
+      const vector<char> data = abi_ser.variant_to_binary( type, row, abi_serializer_max_time );
+      write_state( [&]( chainbase::database& db ) {
+         const auto& t_id = eosio_table( db, table );
+         const auto* obj = db.find<key_value_object, by_scope_primary>( boost::make_tuple( t_id.id, primary_key ) );
+         if( obj == nullptr ) {
+            db.create<key_value_object>( [&]( auto& o ) {
+               o.t_id        = t_id.id;
+               o.primary_key = primary_key;
+               o.payer       = config::system_account_name;
+               o.value.assign( data.data(), data.size() );
+            });
+            db.modify( t_id, [&]( auto& t ) {
+               ++t.count;
+            });
+         } else {
+            db.modify( *obj, [&]( auto& o ) {
+               o.value.assign( data.data(), data.size() );
+            });
+         }
+      });
+   }
+
+   // secondary key of a new row in the first uint64_t index of the table, named as multi_index names it
+   void add_eosio_index64( name table, uint64_t primary_key, uint64_t secondary_key ) {
+      write_state( [&]( chainbase::database& db ) {
+         const auto& t_id = eosio_table( db, name( table.value & 0xFFFFFFFFFFFFFFF0ULL ) );
+         db.create<index64_object>( [&]( auto& o ) {
+            o.t_id          = t_id.id;
+            o.primary_key   = primary_key;
+            o.payer         = config::system_account_name;
+            o.secondary_key = secondary_key;
+         });
+         db.modify( t_id, [&]( auto& t ) {
+            ++t.count;
+         });
+      });
+   }
+
+   // A stakers row as the per-step refresh left it, counted in the global4 totals like a stake of that contract
+   void add_legacy_staker( const account_name& username, time_point last_update_at, const asset& cru, const asset& wcru,
+                           const asset& frozen_wcru, const asset& emitted ) {
+      const uint64_t staked = uint64_t( cru.get_amount() + wcru.get_amount() );
+      set_eosio_row( N(stakers), username.value, "stakers", mvo()
+                     ("username", username)
+                     ("last_update_at", last_update_at)
+                     ("staked_balance", staked)
+                     ("staked_cru_balance", cru)
+                     ("staked_frozen_cru_balance", asset::from_string("0.0000 CRU"))
+                     ("staked_wcru_balance", wcru)
+                     ("staked_frozen_wcru_balance", frozen_wcru)
+                     ("emitted_segments", 0)
+                     ("emitted_balance", emitted)
+      );
+      // multi_index erases the row through its bystaked index
+      add_eosio_index64( N(stakers), username.value, staked );
+
+      const auto g4 = get_global_state4();
+      set_eosio_row( N(global4), N(global4).value, "eosio_global_state4", mvo( g4.get_object() )
+                     ("total_stakers_balance", g4["total_stakers_balance"].as_uint64() + staked)
+                     ("total_stakers_cru_balance", g4["total_stakers_cru_balance"].as<asset>() + cru)
+                     ("total_stakers_wcru_balance", g4["total_stakers_wcru_balance"].as<asset>() + wcru)
+                     ("total_stakers_frozen_wcru_balance", g4["total_stakers_frozen_wcru_balance"].as<asset>() + frozen_wcru)
+      );
+   }
+
+   // Stakers' share of the emission schedule over [from, to) in token units, summed block by block as
+   // onblock fills the stakers bucket. 95% before upd_percentage_time_point, where the tester chain is.
+   int64_t expected_stakers_emission( time_point from, time_point to ) const {
+      static const int64_t rates[] = { 400000, 380000, 370000, 340000, 320000, 300000 }; // per block, steps 0 to 5
+      int64_t emission = 0;
+      for( int64_t usecs = ( from - activated_at ).count(); usecs < ( to - activated_at ).count(); usecs += 500000 ) {
+         if( usecs < 0 ) {
+            continue;
+         }
+         const int64_t step = usecs / step_usecs;
+         BOOST_REQUIRE( step < 6 );
+         emission += rates[step];
+      }
+      return emission * 95 / 100;
+   }
+
+   time_point activated_at;
+   int64_t    step_usecs = 0;
+};
+
+BOOST_FIXTURE_TEST_CASE( stakers_accrue_across_emission_steps, eosio_staker_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 60 ) ); // a step per 120 blocks
+   produce_blocks( 10 );
+
+   // the first staker action starts the index
+   const time_point t0 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), frstake( N(staker1), asset::from_string("1000.0000 WCRU") ) );
+   BOOST_REQUIRE_EQUAL( uint64_t( t0.time_since_epoch().count() ), microseconds_since_epoch_of_iso_string( get_global_state5()["stakers_index_started_at"] ) );
+   produce_blocks( 200 );
+
+   // staker1 alone over steps 0 and 1, settled in the block staker2 joins in
+   const time_point t1 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refresh( N(staker1) ) );
+   BOOST_REQUIRE_EQUAL( success(), frstake( N(staker2), asset::from_string("3000.0000 WCRU") ) );
+   const int64_t staker1_alone = emitted_of( N(staker1) );
+   BOOST_REQUIRE_EQUAL( 0, emitted_of( N(staker2) ) );
+   BOOST_REQUIRE( staker1_alone > 0 );
+   BOOST_REQUIRE( std::abs( staker1_alone - expected_stakers_emission( t0, t1 ) ) <= 1 );
+   produce_blocks( 200 );
+
+   // both over steps 1 to 3, staked 1:3 on the same index
+   const time_point t2 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refreshmany( { N(staker1), N(staker2) } ) );
+   const int64_t staker1_shared = emitted_of( N(staker1) ) - staker1_alone;
+   const int64_t staker2_shared = emitted_of( N(staker2) );
+   BOOST_REQUIRE( staker2_shared - 3 * staker1_shared >= 0 );
+   BOOST_REQUIRE( staker2_shared - 3 * staker1_shared <= 2 );
+   BOOST_REQUIRE( std::abs( staker1_shared + staker2_shared - expected_stakers_emission( t1, t2 ) ) <= 3 );
+
+   // settled rows carry the index and time they were settled at
+   const auto g5 = get_global_state5();
+   BOOST_REQUIRE_EQUAL( uint64_t( t2.time_since_epoch().count() ), microseconds_since_epoch_of_iso_string( g5["stakers_index_updated_at"] ) );
+   for( auto username : { N(staker1), N(staker2) } ) {
+      const auto st = get_staker( username );
+      BOOST_REQUIRE_EQUAL( uint64_t( t2.time_since_epoch().count() ), microseconds_since_epoch_of_iso_string( st["last_update_at"] ) );
+      BOOST_REQUIRE_EQUAL( g5["stakers_reward_index"].as_string(), st["reward_index"].as_string() );
+   }
+
+   // nothing more within the same block
+   BOOST_REQUIRE_EQUAL( success(), refresh( N(staker2) ) );
+   BOOST_REQUIRE_EQUAL( staker2_shared, emitted_of( N(staker2) ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( stakers_shortfall_counts_what_the_bucket_misses, eosio_staker_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 10 );
+
+   const time_point t0 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), frstake( N(staker1), asset::from_string("1000.0000 WCRU") ) );
+   produce_blocks( 20 );
+
+   // a bucket emptied behind the index, as the mints stopping at max supply leave it
+   const auto g4 = get_global_state4();
+   set_eosio_row( N(global4), N(global4).value, "eosio_global_state4", mvo( g4.get_object() )
+                  ("stakers_bucket", asset::from_string("0.0000 UNTB"))
+   );
+
+   // the refresh pays what the bucket holds, the rest of the accrued reward is counted, not paid
+   const time_point t = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refresh( N(staker1) ) );
+   const int64_t shortfall = get_global_state5()["stakers_shortfall"].as<int64_t>();
+   BOOST_REQUIRE( shortfall > 0 );
+   BOOST_REQUIRE( std::abs( emitted_of( N(staker1) ) + shortfall - expected_stakers_emission( t0, t ) ) <= 1 );
+   BOOST_REQUIRE_EQUAL( asset::from_string("0.0000 UNTB"), get_global_state4()["stakers_bucket"].as<asset>() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( getreward_after_staker_migration, eosio_staker_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 20 );
+
+   // last refreshed per step by the contract before the index
+   const time_point last_update = control->pending_block_time();
+   add_legacy_staker( N(staker3), last_update, asset::from_string("2000.0000 CRU"), asset::from_string("0.0000 WCRU"),
+                      asset::from_string("0.0000 WCRU"), asset::from_string("5.0000 UNTB") );
+   produce_blocks( 100 );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("Not enought emitted balance for withdraw"),
+                        getreward( N(staker3), asset::from_string("1000.0000 UNTB") ) );
+   BOOST_REQUIRE( has_legacy_row( N(stakers), N(staker3) ) );
+
+   // getreward moves the row over: the index starts now, the legacy reward is caught up to this point
+   const time_point migrated_at = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), getreward( N(staker3), asset::from_string("5.0000 UNTB") ) );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers), N(staker3) ) );
+   BOOST_REQUIRE_EQUAL( asset::from_string("5.0000 UNTB"), get_balance( N(staker3), symbol(4, "UNTB") ) );
+
+   // The catch-up shares the emission since last_update by total_stakers_balance at migration, not by
+   // the totals over the period. staker3 is the only staker throughout, so it gets all of it; a stake
+   // added or removed in between would shift the share by the change.
+   const auto st = get_staker( N(staker3) );
+   const int64_t catch_up = st["emitted"].as<int64_t>();
+   BOOST_REQUIRE( std::abs( catch_up - expected_stakers_emission( last_update, migrated_at ) ) <= 1 );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state5()["stakers_shortfall"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 2000'0000, st["staked_cru"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 0, st["staked_wcru"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( "0", st["reward_index"].as_string() );
+   BOOST_REQUIRE_EQUAL( uint64_t( migrated_at.time_since_epoch().count() ), microseconds_since_epoch_of_iso_string( get_global_state5()["stakers_index_started_at"] ) );
+   produce_blocks( 50 );
+
+   // from here on the index pays it
+   const time_point t = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refresh( N(staker3) ) );
+   const int64_t accrued = emitted_of( N(staker3) ) - catch_up;
+   BOOST_REQUIRE( std::abs( accrued - expected_stakers_emission( migrated_at, t ) ) <= 1 );
+
+   BOOST_REQUIRE_EQUAL( success(), getreward( N(staker3), asset( catch_up + accrued, symbol(4, "UNTB") ) ) );
+   BOOST_REQUIRE_EQUAL( 0, emitted_of( N(staker3) ) );
+   BOOST_REQUIRE_EQUAL( asset( 5'0000 + catch_up + accrued, symbol(4, "UNTB") ), get_balance( N(staker3), symbol(4, "UNTB") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("Nothing to withdraw"), getreward( N(staker3), asset::from_string("0.0001 UNTB") ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( migratestkr_max_rows, eosio_staker_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 10 );
+
+   const time_point t = control->pending_block_time();
+   for( auto username : { N(staker1), N(staker2), N(staker3) } ) {
+      add_legacy_staker( username, t, asset::from_string("100.0000 CRU"), asset::from_string("0.0000 WCRU"),
+                         asset::from_string("0.0000 WCRU"), asset::from_string("0.0000 UNTB") );
+   }
+   // fully unstaked, only the withdraw row is left
+   set_eosio_row( N(stakers3), N(staker4).value, "stakers3", mvo()
+                  ("username", "staker4")
+                  ("cru_on_widthdraw", "10.0000 CRU")
+                  ("wcru_on_widthdraw", "0.0000 WCRU")
+                  ("last_update_at", t)
+   );
+   set_eosio_row( N(stakers2), N(staker1).value, "stakers2", mvo()
+                  ("username", "staker1")
+                  ("current_update_at", t)
+   );
+   produce_block();
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(staker1), N(migratestkr), mvo()("max_rows", 10) ) );
+
+   // stakers rows first, in name order
+   BOOST_REQUIRE_EQUAL( success(), migratestkr( 2 ) );
+   BOOST_REQUIRE( !get_staker( N(staker1) ).is_null() );
+   BOOST_REQUIRE( !get_staker( N(staker2) ).is_null() );
+   BOOST_REQUIRE( get_staker( N(staker3) ).is_null() );
+   BOOST_REQUIRE( get_staker( N(staker4) ).is_null() );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers), N(staker1) ) );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers2), N(staker1) ) );
+   BOOST_REQUIRE( has_legacy_row( N(stakers), N(staker3) ) );
+   BOOST_REQUIRE( has_legacy_row( N(stakers3), N(staker4) ) );
+   BOOST_REQUIRE_EQUAL( false, get_global_state5()["stakers_migrated"].as_bool() );
+   BOOST_REQUIRE_EQUAL( 100'0000, get_staker( N(staker1) )["staked_cru"].as<int64_t>() );
+
+   BOOST_REQUIRE_EQUAL( success(), migratestkr( 2 ) );
+   BOOST_REQUIRE_EQUAL( 100'0000, get_staker( N(staker3) )["staked_cru"].as<int64_t>() );
+   const auto st4 = get_staker( N(staker4) );
+   BOOST_REQUIRE_EQUAL( 0, st4["staked_cru"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 10'0000, st4["cru_on_withdraw"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( uint64_t( t.time_since_epoch().count() ), microseconds_since_epoch_of_iso_string( st4["withdraw_updated_at"] ) );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers), N(staker3) ) );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers3), N(staker4) ) );
+   BOOST_REQUIRE_EQUAL( true, get_global_state5()["stakers_migrated"].as_bool() );
+
+   produce_block();
+   BOOST_REQUIRE_EQUAL( success(), migratestkr( 2 ) );
+   BOOST_REQUIRE_EQUAL( true, get_global_state5()["stakers_migrated"].as_bool() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( frstake_frunstake_migrated_rows, eosio_staker_tester ) try {
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 10 );
+
+   const time_point t = control->pending_block_time();
+   add_legacy_staker( N(staker1), t, asset::from_string("0.0000 CRU"), asset::from_string("500.0000 WCRU"),
+                      asset::from_string("200.0000 WCRU"), asset::from_string("0.0000 UNTB") );
+   add_legacy_staker( N(staker2), t, asset::from_string("0.0000 CRU"), asset::from_string("50.0000 WCRU"),
+                      asset::from_string("50.0000 WCRU"), asset::from_string("0.0000 UNTB") );
+   produce_block();
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of tokenlock"),
+                        push_action( N(staker1), N(frstake), mvo()("username", "staker1")("quantity", "100.0000 WCRU") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("Wrong token symbol for staking"),
+                        frstake( N(staker1), asset::from_string("100.0000 CRU") ) );
+   BOOST_REQUIRE( has_legacy_row( N(stakers), N(staker1) ) );
+
+   // frstake migrates the row and adds to it
+   BOOST_REQUIRE_EQUAL( success(), frstake( N(staker1), asset::from_string("100.0000 WCRU") ) );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers), N(staker1) ) );
+   auto st = get_staker( N(staker1) );
+   BOOST_REQUIRE_EQUAL( 600'0000, st["staked_wcru"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 300'0000, st["staked_frozen_wcru"].as<int64_t>() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("Not enought frozen tokens for unstake"),
+                        frunstake( N(staker1), asset::from_string("300.0001 WCRU") ) );
+   BOOST_REQUIRE_EQUAL( success(), frunstake( N(staker1), asset::from_string("300.0000 WCRU") ) );
+   st = get_staker( N(staker1) );
+   BOOST_REQUIRE_EQUAL( 300'0000, st["staked_wcru"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 0, st["staked_frozen_wcru"].as<int64_t>() );
+
+   // frunstake migrates the row as well
+   BOOST_REQUIRE_EQUAL( success(), frunstake( N(staker2), asset::from_string("50.0000 WCRU") ) );
+   BOOST_REQUIRE( !has_legacy_row( N(stakers), N(staker2) ) );
+   st = get_staker( N(staker2) );
+   BOOST_REQUIRE_EQUAL( 0, st["staked_wcru"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 0, st["staked_frozen_wcru"].as<int64_t>() );
+
+   // the totals follow the rows
+   const auto g4 = get_global_state4();
+   BOOST_REQUIRE_EQUAL( uint64_t(300'0000), g4["total_stakers_balance"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( asset::from_string("300.0000 WCRU"), g4["total_stakers_wcru_balance"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( asset::from_string("0.0000 WCRU"), g4["total_stakers_frozen_wcru_balance"].as<asset>() );
+
+   // rows moved over are not moved again
+   BOOST_REQUIRE_EQUAL( success(), migratestkr( 10 ) );
+   BOOST_REQUIRE_EQUAL( true, get_global_state5()["stakers_migrated"].as_bool() );
+   BOOST_REQUIRE_EQUAL( 300'0000, get_staker( N(staker1) )["staked_wcru"].as<int64_t>() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( syncsupply_reloads_core_supply, eosio_staker_tester ) try {
+
+   auto stat_supply = [&]() {
+      return get_stats("4,UNTB")["supply"].as<asset>().get_amount();
+   };
+   auto retire = [&]( const asset& quantity ) {
+      base_tester::push_action( N(eosio.token), N(retire), config::system_account_name, mvo()
+                                ("username", "eosio")
+                                ("quantity", quantity)
+                                ("memo", "")
+      );
+   };
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 10 );
+
+   // loaded by the first onblock after activation, then followed by the mints without reading the stat row
+   auto g5 = get_global_state5();
+   BOOST_REQUIRE( stat_supply() > 1000000000'0000ll );
+   BOOST_REQUIRE_EQUAL( stat_supply(), g5["core_supply"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 10000000000'0000ll, g5["core_max_supply"].as<int64_t>() );
+   const uint64_t loaded_at = microseconds_since_epoch_of_iso_string( g5["supply_synced_at"] );
+
+   // a retire is not seen until the next reload
+   retire( asset::from_string("1000.0000 UNTB") );
+   produce_blocks( 5 );
+   g5 = get_global_state5();
+   BOOST_REQUIRE_EQUAL( stat_supply() + 1000'0000, g5["core_supply"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( loaded_at, microseconds_since_epoch_of_iso_string( g5["supply_synced_at"] ) );
+
+   // anyone can reload it
+   const time_point synced_at = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(staker1), N(syncsupply), mvo() ) );
+   g5 = get_global_state5();
+   BOOST_REQUIRE_EQUAL( stat_supply(), g5["core_supply"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( uint64_t( synced_at.time_since_epoch().count() ), microseconds_since_epoch_of_iso_string( g5["supply_synced_at"] ) );
+   produce_blocks( 5 );
+   BOOST_REQUIRE_EQUAL( stat_supply(), get_global_state5()["core_supply"].as<int64_t>() );
+
+   // and onblock reloads it once a day
+   retire( asset::from_string("500.0000 UNTB") );
+   produce_blocks( 5 );
+   BOOST_REQUIRE_EQUAL( stat_supply() + 500'0000, get_global_state5()["core_supply"].as<int64_t>() );
+   produce_block( fc::days(1) );
+   g5 = get_global_state5();
+   BOOST_REQUIRE_EQUAL( stat_supply(), g5["core_supply"].as<int64_t>() );
+   BOOST_REQUIRE( microseconds_since_epoch_of_iso_string( g5["supply_synced_at"] ) >= uint64_t( synced_at.time_since_epoch().count() ) + 86400'000000ull );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( emission_accrues_until_a_bucket_is_drawn, eosio_staker_tester ) try {
+
+   const symbol untb_symbol( 4, "UNTB" );
+   const account_name producer( N(accrualprod1) );
+   const account_name voter( N(accrualvote1) );
+   auto untb = [&]( int64_t tokens ) {
+      return asset( tokens * 10000, untb_symbol );
+   };
+   auto stat_supply = [&]() {
+      return get_stats("4,UNTB")["supply"].as<asset>().get_amount();
+   };
+   auto balance_of = [&]( const account_name& account ) {
+      return get_balance( account, untb_symbol ).get_amount();
+   };
+   auto pending_of = []( const fc::variant& g5 ) {
+      return g5["pending_savings"].as<int64_t>() + g5["pending_perblock"].as<int64_t>()
+           + g5["pending_pervote"].as<int64_t>() + g5["pending_owner"].as<int64_t>();
+   };
+
+   setup_producer_accounts( { producer }, untb( 1 ), untb( 80 ), untb( 80 ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(regproducer), mvo()
+                                                ("producer",     producer)
+                                                ("producer_key", get_public_key( producer, "active" ))
+                                                ("url",          "")
+                                                ("location",     0)
+   ));
+   create_account_with_resources( voter, config::system_account_name, untb( 10 ), false, untb( 10 ), untb( 10 ) );
+   transfer( config::system_account_name, voter, untb( 2000 ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( voter, untb( 1000 ), untb( 1000 ) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( voter, { producer } ) );
+
+   // a day between mints; nothing was minted yet, so the first onblock after activation mints
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setemitflush), mvo()("flush_interval_sec", 86400) ) );
+   const int64_t initial_supply = stat_supply();
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 2 );
+   BOOST_REQUIRE( stat_supply() > initial_supply );
+   BOOST_REQUIRE_EQUAL( 86400, get_global_state5()["emission_flush_interval"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( success(), frstake( N(staker1), asset::from_string("1000.0000 WCRU") ) );
+
+   // from then on every onblock accrues, the supply and the accounts of the buckets stay as they are
+   const int64_t supply = stat_supply();
+   const int64_t saving = balance_of( N(eosio.saving) );
+   produce_blocks( 20 );
+   auto g5 = get_global_state5();
+   for( auto field : { "pending_savings", "pending_perblock", "pending_pervote", "pending_owner" } ) {
+      BOOST_REQUIRE( g5[field].as<int64_t>() > 0 );
+   }
+   BOOST_REQUIRE_EQUAL( supply, stat_supply() );
+   BOOST_REQUIRE_EQUAL( saving, balance_of( N(eosio.saving) ) );
+   produce_block();
+   BOOST_REQUIRE( pending_of( get_global_state5() ) > pending_of( g5 ) );
+   BOOST_REQUIRE_EQUAL( supply, stat_supply() );
+
+   // getreward mints all of it before eosio.saving pays a reward it does not hold yet
+   BOOST_REQUIRE_EQUAL( success(), refresh( N(staker1) ) );
+   const int64_t emitted = emitted_of( N(staker1) );
+   BOOST_REQUIRE( emitted > balance_of( N(eosio.saving) ) );
+   g5 = get_global_state5();
+   BOOST_REQUIRE_EQUAL( success(), getreward( N(staker1), asset( emitted, untb_symbol ) ) );
+   BOOST_REQUIRE_EQUAL( emitted, balance_of( N(staker1) ) );
+   BOOST_REQUIRE_EQUAL( saving + g5["pending_savings"].as<int64_t>() - emitted, balance_of( N(eosio.saving) ) );
+   BOOST_REQUIRE_EQUAL( supply + pending_of( g5 ), stat_supply() );
+   BOOST_REQUIRE_EQUAL( 0, pending_of( get_global_state5() ) );
+
+   // claimrewards does the same for eosio.bpay and eosio.vpay, once the producer has blocks to be paid for
+   for( uint32_t i = 0; i < 1000 && control->head_block_producer() != producer; ++i ) {
+      produce_block();
+   }
+   BOOST_REQUIRE_EQUAL( producer, control->head_block_producer() );
+   // counted in unpaidblks only, the global total follows when a new schedule is proposed
+   const uint32_t flushed_blocks = get_global_state()["total_unpaid_blocks"].as<uint32_t>();
+   const uint32_t unpaid_blocks = get_total_unpaid_blocks();
+   produce_blocks( 10 );
+   BOOST_REQUIRE( get_unpaid_blocks( producer ) > 0 );
+   BOOST_REQUIRE_EQUAL( flushed_blocks, get_global_state()["total_unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( unpaid_blocks + 10, get_total_unpaid_blocks() );
+
+   g5 = get_global_state5();
+   BOOST_REQUIRE( g5["pending_perblock"].as<int64_t>() > 0 );
+   const int64_t claim_supply = stat_supply();
+   const int64_t buckets = balance_of( N(eosio.bpay) ) + balance_of( N(eosio.vpay) );
+   const int64_t producer_balance = balance_of( producer );
+   BOOST_REQUIRE_EQUAL( success(), push_action( producer, N(claimrewards), mvo()("owner", producer) ) );
+   const int64_t paid = balance_of( producer ) - producer_balance;
+   BOOST_REQUIRE( paid > 0 );
+   BOOST_REQUIRE_EQUAL( buckets + g5["pending_perblock"].as<int64_t>() + g5["pending_pervote"].as<int64_t>() - paid,
+                        balance_of( N(eosio.bpay) ) + balance_of( N(eosio.vpay) ) );
+   BOOST_REQUIRE_EQUAL( claim_supply + pending_of( g5 ), stat_supply() );
+   BOOST_REQUIRE_EQUAL( 0, pending_of( get_global_state5() ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( refreshcrank_settles_the_stalest_first, eosio_staker_tester ) try {
+
+   auto updated_at = [&]( const account_name& username ) {
+      return microseconds_since_epoch_of_iso_string( get_staker( username )["last_update_at"] );
+   };
+   auto usecs = []( time_point t ) {
+      return uint64_t( t.time_since_epoch().count() );
+   };
+
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 10 );
+
+   // staked a block apart, then staker1 is refreshed: staker2 is the stalest, staker3 the next
+   for( auto username : { N(staker1), N(staker2), N(staker3) } ) {
+      BOOST_REQUIRE_EQUAL( success(), frstake( username, asset::from_string("1000.0000 WCRU") ) );
+      produce_block();
+   }
+   const time_point t1 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refresh( N(staker1) ) );
+   produce_block();
+
+   const time_point t2 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refreshcrank( 2 ) );
+   BOOST_REQUIRE_EQUAL( usecs( t1 ), updated_at( N(staker1) ) );
+   BOOST_REQUIRE_EQUAL( usecs( t2 ), updated_at( N(staker2) ) );
+   BOOST_REQUIRE_EQUAL( usecs( t2 ), updated_at( N(staker3) ) );
+   BOOST_REQUIRE( emitted_of( N(staker2) ) > 0 );
+   produce_block();
+
+   // the next call goes on with staker1, then with the first of the two settled together
+   const time_point t3 = control->pending_block_time();
+   BOOST_REQUIRE_EQUAL( success(), refreshcrank( 2 ) );
+   BOOST_REQUIRE_EQUAL( usecs( t3 ), updated_at( N(staker1) ) );
+   BOOST_REQUIRE_EQUAL( usecs( t3 ), updated_at( N(staker2) ) );
+   BOOST_REQUIRE_EQUAL( usecs( t2 ), updated_at( N(staker3) ) );
+
+   // and stops at the rows already settled in this block
+   BOOST_REQUIRE_EQUAL( success(), refreshcrank( 5 ) );
+   BOOST_REQUIRE_EQUAL( usecs( t3 ), updated_at( N(staker3) ) );
+
+   // at most as many rows as refreshmany takes names
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "too many stakers, at most 100 per refreshcrank" ), refreshcrank( 101 ) );
+   BOOST_REQUIRE_EQUAL( success(), refreshcrank( 100 ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( top_producers_follow_the_votes, eosio_staker_tester ) try {
+
+   auto untb = []( int64_t tokens ) {
+      return asset::from_string( std::to_string( tokens ) + ".0000 UNTB" );
+   };
+   auto regproducer_at = [&]( const account_name& producer, uint16_t location ) {
+      return push_action( config::system_account_name, N(regproducer), mvo()
+                          ("producer",     producer)
+                          ("producer_key", get_public_key( producer, "active" ))
+                          ("url",          "")
+                          ("location",     location)
+      );
+   };
+   auto unregprod = [&]( const account_name& producer ) {
+      return push_action( config::system_account_name, N(unregprod), mvo()("producer", producer) );
+   };
+   auto get_top_producers = [&]() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(topprods), N(topprods) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "top_producers_state", data, abi_serializer_max_time );
+   };
+
+   // rankprodaa .. rankprodbg, 33 producers
+   std::vector<account_name> producers;
+   for( uint32_t i = 0; i < 33; ++i ) {
+      producers.emplace_back( "rankprod" + std::string( 1, char('a' + i / 26) ) + std::string( 1, char('a' + i % 26) ) );
+   }
+   setup_producer_accounts( producers, untb( 1 ), untb( 80 ), untb( 80 ) );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer_at( p, 0 ) );
+   }
+
+   auto votes_of = [&]( const account_name& producer ) {
+      return get_producer_info( producer )["total_votes"].as<double>();
+   };
+   auto ranked = [&]( const fc::variant& top, const account_name& producer ) {
+      const auto& ranks = top["producers"].get_array();
+      return std::any_of( ranks.begin(), ranks.end(), [&]( const fc::variant& r ) { return r["owner"].as<account_name>() == producer; } );
+   };
+   // the ranking is a prefix of the prototalvote order, with the key and location of each producer row,
+   // and no active producer left out has more votes than cutoff
+   auto require_index_order = [&]() {
+      std::vector< std::pair<double, account_name> > index;
+      for( const auto& p : producers ) {
+         const auto info = get_producer_info( p );
+         if( info["is_active"].as<bool>() && 0 < info["total_votes"].as<double>() ) {
+            index.emplace_back( -info["total_votes"].as<double>(), p );
+         }
+      }
+      std::sort( index.begin(), index.end() );
+
+      const auto top = get_top_producers();
+      BOOST_REQUIRE( top["built"].as<bool>() );
+      const auto& ranks = top["producers"].get_array();
+      BOOST_REQUIRE_LE( ranks.size(), index.size() );
+      for( size_t i = 0; i < ranks.size(); ++i ) {
+         BOOST_REQUIRE_EQUAL( index[i].second, ranks[i]["owner"].as<account_name>() );
+         BOOST_REQUIRE_EQUAL( -index[i].first, ranks[i]["total_votes"].as<double>() );
+         const auto info = get_producer_info( index[i].second );
+         BOOST_REQUIRE_EQUAL( fc::crypto::public_key( info["producer_key"].as_string() ), fc::crypto::public_key( ranks[i]["producer_key"].as_string() ) );
+         BOOST_REQUIRE_EQUAL( info["location"].as<uint16_t>(), ranks[i]["location"].as<uint16_t>() );
+      }
+      for( size_t i = ranks.size(); i < index.size(); ++i ) {
+         BOOST_REQUIRE( -index[i].first <= top["cutoff"].as<double>() );
+      }
+      return top;
+   };
+
+   // voter j stakes 2^j thousand tokens and votes for the producers i with bit j set in i + 1,
+   // so producer i has i + 1 units of votes
+   for( uint32_t j = 0; j < 6; ++j ) {
+      const account_name voter( "rankvoter" + std::string( 1, char('a' + j) ) );
+      const asset half = untb( 500 << j );
+      create_account_with_resources( voter, config::system_account_name, untb( 10 ), false, untb( 10 ), untb( 10 ) );
+      transfer( config::system_account_name, voter, half + half );
+      BOOST_REQUIRE_EQUAL( success(), stake( voter, half, half ) );
+      std::vector<account_name> votes;
+      for( uint32_t i = 0; i < producers.size(); ++i ) {
+         if( (i + 1) & (1u << j) ) {
+            votes.push_back( producers[i] );
+         }
+      }
+      BOOST_REQUIRE_EQUAL( success(), vote( voter, votes ) );
+   }
+
+   // the first update_elected_producers after activation builds the ranking from the index:
+   // rankprodad .. rankprodbg, the 30 with the most votes, and rankprodac at the cutoff
+   BOOST_REQUIRE_EQUAL( success(), activate_emission( 3600 ) );
+   produce_blocks( 2 );
+   auto top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 30, top["producers"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( votes_of( producers[2] ), top["cutoff"].as<double>() );
+   BOOST_REQUIRE( !ranked( top, producers[2] ) );
+   BOOST_REQUIRE( ranked( top, producers[3] ) );
+
+   // 10 units more for rankprodab, 2 units: it enters and pushes rankprodad, the last one, out
+   const account_name mover( N(rankvoterx) );
+   create_account_with_resources( mover, config::system_account_name, untb( 10 ), false, untb( 10 ), untb( 10 ) );
+   transfer( config::system_account_name, mover, untb( 10000 ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( mover, untb( 5000 ), untb( 5000 ) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( mover, { producers[1] } ) );
+   top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 30, top["producers"].get_array().size() );
+   BOOST_REQUIRE( ranked( top, producers[1] ) );
+   BOOST_REQUIRE( !ranked( top, producers[3] ) );
+   BOOST_REQUIRE_EQUAL( votes_of( producers[3] ), top["cutoff"].as<double>() );
+
+   // moved to rankprodaa: it enters and pushes rankprodae out, rankprodab falls below the cutoff and leaves
+   BOOST_REQUIRE_EQUAL( success(), vote( mover, { producers[0] } ) );
+   top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 29, top["producers"].get_array().size() );
+   BOOST_REQUIRE( ranked( top, producers[0] ) );
+   BOOST_REQUIRE( !ranked( top, producers[1] ) );
+   BOOST_REQUIRE( !ranked( top, producers[4] ) );
+   BOOST_REQUIRE_EQUAL( votes_of( producers[4] ), top["cutoff"].as<double>() );
+
+   // unregprod and rmvproducer take the first two out
+   BOOST_REQUIRE_EQUAL( success(), unregprod( producers[32] ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(rmvproducer), mvo()("producer", producers[31]) ) );
+   top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 27, top["producers"].get_array().size() );
+   BOOST_REQUIRE( !ranked( top, producers[32] ) );
+   BOOST_REQUIRE( !ranked( top, producers[31] ) );
+
+   // registering again updates the entry
+   BOOST_REQUIRE_EQUAL( success(), regproducer_at( producers[30], 7 ) );
+   top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 7, top["producers"].get_array()[0]["location"].as<uint16_t>() );
+
+   // below 21 entries the ranking waits for the next update_elected_producers, which rebuilds it
+   for( uint32_t i = 23; i < 30; ++i ) {
+      BOOST_REQUIRE_EQUAL( success(), unregprod( producers[i] ) );
+   }
+   top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 20, top["producers"].get_array().size() );
+   produce_block( fc::seconds(61) );
+   produce_blocks( 2 );
+   // rankprodaa .. rankprodaw and rankprodbe, every active producer with votes
+   top = require_index_order();
+   BOOST_REQUIRE_EQUAL( 24, top["producers"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( 0, top["cutoff"].as<double>() );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -118,6 +118,27 @@ public:
       );
    }
 
+   fc::variant get_symrule( const string& code )
+   {
+      auto symbol_code = eosio::chain::symbol::from_string( "0," + code ).to_symbol_code().value;
+      vector<char> data = get_row_by_account( N(eosio.token), N(eosio.token), N(symrule), symbol_code );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "symrule", data, abi_serializer_max_time );
+   }
+
+   action_result setsymrule( const string& code, uint8_t set_flags, uint8_t clear_flags ) {
+      return push_action( N(eosio.token), N(setsymrule), mvo()
+           ( "code", code )
+           ( "set_flags", set_flags )
+           ( "clear_flags", clear_flags )
+      );
+   }
+
+   action_result rmsymrule( const string& code ) {
+      return push_action( N(eosio.token), N(rmsymrule), mvo()
+           ( "code", code )
+      );
+   }
+
    abi_serializer abi_ser;
 };
 
@@ -415,4 +436,48 @@ BOOST_FIXTURE_TEST_CASE( close_tests, eosio_token_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( symrule_tests, eosio_token_tester ) try {
+
+   // symbol_policy flags: limit_exempt = 1, tokenlock_tracked = 2
+   BOOST_REQUIRE_EQUAL( true, get_symrule("CRU").is_null() );
+
+   BOOST_REQUIRE_EQUAL( error( "missing authority of eosio.token" ),
+                        push_action( N(alice), N(setsymrule), mvo()( "code", "CRU" )( "set_flags", 0 )( "clear_flags", 2 ) ) );
+
+   // CRU is tokenlock tracked by the built-in rules, the rule clears that and makes it limit exempt
+   BOOST_REQUIRE_EQUAL( success(), setsymrule( "CRU", 1, 2 ) );
+   REQUIRE_MATCHING_OBJECT( get_symrule("CRU"), mvo()
+      ("code", "CRU")
+      ("set_flags", 1)
+      ("clear_flags", 2)
+   );
+
+   // a second setsymrule replaces the rule
+   BOOST_REQUIRE_EQUAL( success(), setsymrule( "CRU", 0, 1 ) );
+   REQUIRE_MATCHING_OBJECT( get_symrule("CRU"), mvo()
+      ("code", "CRU")
+      ("set_flags", 0)
+      ("clear_flags", 1)
+   );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "flag both set and cleared" ), setsymrule( "CRU", 3, 2 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "flag both set and cleared" ), setsymrule( "EOS", 1, 1 ) );
+   REQUIRE_MATCHING_OBJECT( get_symrule("CRU"), mvo()
+      ("code", "CRU")
+      ("set_flags", 0)
+      ("clear_flags", 1)
+   );
+   BOOST_REQUIRE_EQUAL( true, get_symrule("EOS").is_null() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "symbol rule not found" ), rmsymrule( "EOS" ) );
+
+   BOOST_REQUIRE_EQUAL( error( "missing authority of eosio.token" ),
+                        push_action( N(alice), N(rmsymrule), mvo()( "code", "CRU" ) ) );
+   BOOST_REQUIRE_EQUAL( success(), rmsymrule( "CRU" ) );
+   BOOST_REQUIRE_EQUAL( true, get_symrule("CRU").is_null() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "symbol rule not found" ), rmsymrule( "CRU" ) );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,200 @@
+#include <boost/test/unit_test.hpp>
+
+#include <eosio.system/bancor.hpp>
+#include <eosio.system/fixed_point.hpp>
+#include <eosio.system/vote_weight.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+using eosiosystem::fixed_point;
+
+namespace {
+
+   // the double implementations replaced by fixed_point, kept here as the reference
+
+   int64_t double_convert_to_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      double R(supply);
+      double C(balance + in);
+      double F(weight);
+      double T(in);
+      double ONE(1.0);
+      return int64_t( -R * (ONE - std::pow( ONE + T / C, F) ) );
+   }
+
+   // exchange_state::convert_to_exchange
+   int64_t fixed_convert_to_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      return eosiosystem::bancor_to_exchange( supply, balance, eosiosystem::bancor_weight_of( weight ), in );
+   }
+
+   int64_t double_convert_from_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      double R(supply - in);
+      double C(balance);
+      double F(1.0/weight);
+      double E(in);
+      double ONE(1.0);
+      return int64_t( C * (std::pow( ONE + E/R, F) - ONE) );
+   }
+
+   // exchange_state::convert_from_exchange
+   int64_t fixed_convert_from_exchange( int64_t supply, int64_t balance, double weight, int64_t in ) {
+      return eosiosystem::bancor_from_exchange( supply, balance, eosiosystem::bancor_weight_of( weight ), in );
+   }
+
+   // the RAM market as init sets it up, both connectors of the same weight
+   struct ram_market {
+      int64_t supply;  // RAMCORE
+      int64_t base;    // RAM bytes
+      int64_t quote;   // core token
+      double  weight;
+
+      // core -> RAMCORE -> RAM and back, as exchange_state::convert chains the two halves
+      int64_t buy( int64_t core ) {
+         const auto w = eosiosystem::bancor_weight_of( weight );
+         const int64_t ramcore = eosiosystem::bancor_to_exchange( supply, quote, w, core );
+         return eosiosystem::bancor_from_exchange( supply, base, w, ramcore );
+      }
+      int64_t sell( int64_t bytes ) {
+         const auto w = eosiosystem::bancor_weight_of( weight );
+         const int64_t ramcore = eosiosystem::bancor_to_exchange( supply, base, w, bytes );
+         return eosiosystem::bancor_from_exchange( supply, quote, w, ramcore );
+      }
+
+      int64_t double_buy( int64_t core )const {
+         const int64_t ramcore = double_convert_to_exchange( supply, quote, weight, core );
+         return double_convert_from_exchange( supply + ramcore, base, weight, ramcore );
+      }
+      int64_t double_sell( int64_t bytes )const {
+         const int64_t ramcore = double_convert_to_exchange( supply, base, weight, bytes );
+         return double_convert_from_exchange( supply + ramcore, quote, weight, ramcore );
+      }
+   };
+
+   double double_stake2vote( int64_t staked, int64_t weeks ) {
+      return double(staked) * std::pow( 2, weeks / double( 52 ) );
+   }
+
+   double fixed_stake2vote( int64_t staked, int64_t weeks ) {
+      const fixed_point fraction = fixed_point::from_ratio( weeks % 52, 52 );
+      return double( fixed_point::exp2( fraction ).mul_int( staked ) ) * double( uint64_t(1) << (weeks / 52) );
+   }
+
+   // conversions truncate to int64, allow one unit of difference plus the double rounding error
+   void check_close( int64_t expected, int64_t actual ) {
+      const int64_t tolerance = 1 + int64_t( std::fabs( double(expected) ) * 1e-12 );
+      BOOST_REQUIRE_LE( std::llabs( expected - actual ), tolerance );
+   }
+
+}
+
+BOOST_AUTO_TEST_SUITE(fixed_point_tests)
+
+BOOST_AUTO_TEST_CASE( elementary_functions ) {
+   for( double x = -20; x < 40; x += 0.0371 ) {
+      const double r = fixed_point::exp( fixed_point::from_double( x ) ).to_double();
+      // absolute resolution is 2^-64
+      BOOST_REQUIRE_LE( std::fabs( r - std::exp( x ) ), 1e-18 + std::exp( x ) * 1e-14 );
+   }
+   for( double x = 1e-9; x < 1e15; x *= 1.71 ) {
+      const double r = fixed_point::log( fixed_point::from_double( x ) ).to_double();
+      // input resolution is 2^-64, relative error of small inputs is carried into the log
+      BOOST_REQUIRE_LE( std::fabs( r - std::log( x ) ), 1e-13 + 1e-19 / x );
+   }
+   for( double x = 0; x < 40; x += 0.0193 ) {
+      const double r = fixed_point::exp2( fixed_point::from_double( x ) ).to_double();
+      BOOST_REQUIRE_LE( std::fabs( r - std::exp2( x ) ) / std::exp2( x ), 1e-14 );
+   }
+   for( double x = 1e-12; x < 10; x *= 1.93 ) {
+      const double r = fixed_point::log1p( fixed_point::from_double( x ) ).to_double();
+      BOOST_REQUIRE_LE( std::fabs( r - std::log1p( x ) ), 1e-15 + std::log1p( x ) * 1e-14 );
+   }
+
+   BOOST_REQUIRE( fixed_point::exp( fixed_point() ) == fixed_point::one() );
+   BOOST_REQUIRE( fixed_point::log( fixed_point::one() ) == fixed_point() );
+   BOOST_REQUIRE_EQUAL( fixed_point::from_ratio( 5, 2 ).mul_int( -7 ), -17 );
+   BOOST_REQUIRE_EQUAL( fixed_point::from_ratio( -5, 2 ).to_int(), -2 );
+}
+
+BOOST_AUTO_TEST_CASE( exchange_conversions ) {
+   const int64_t supply = 100000000000000ll;
+   for( double weight : { 0.5, 1.0 } ) {
+      for( int64_t balance : { 1000000ll, 8000000000ll, 64ll * 1024 * 1024 * 1024 } ) {
+         for( int64_t in = 1; in < balance; in = in * 7 + 3 ) {
+            check_close( double_convert_to_exchange( supply, balance, weight, in ),
+                         fixed_convert_to_exchange( supply, balance, weight, in ) );
+         }
+         for( int64_t in = 1; in < supply / 2; in = in * 7 + 3 ) {
+            check_close( double_convert_from_exchange( supply, balance, weight, in ),
+                         fixed_convert_from_exchange( supply, balance, weight, in ) );
+         }
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE( bancor_weights ) {
+   // the precomputed weights are the ones from_double gives
+   for( double weight : { 1.0, 0.5 } ) {
+      const auto w = eosiosystem::bancor_weight_of( weight );
+      BOOST_REQUIRE( w.weight == fixed_point::from_double( weight ) );
+      BOOST_REQUIRE( w.reciprocal == fixed_point::from_double( 1.0/weight ) );
+   }
+   const auto w = eosiosystem::bancor_weight_of( 0.25 );
+   BOOST_REQUIRE( w.weight == fixed_point::from_ratio( 1, 4 ) );
+   BOOST_REQUIRE( w.reciprocal == fixed_point::from_int( 4 ) );
+}
+
+BOOST_AUTO_TEST_CASE( ram_market_conversions ) {
+   for( double weight : { 1.0, 0.5 } ) {
+      for( int64_t core_supply : { 10000000000ll, 10000000000000ll, 1000000000000000ll } ) {
+         ram_market m{ 100000000000000ll, 64ll * 1024 * 1024 * 1024, core_supply / 100, weight };
+         // every conversion starts from the market the previous one left behind
+         for( int64_t core = 1; core < m.quote; core += core / 4 + 7 ) {
+            const int64_t expected_bytes = m.double_buy( core );
+            const int64_t bytes = m.buy( core );
+            // each half truncates, a unit of RAMCORE moves the second half by less than a unit on this market
+            BOOST_REQUIRE_LE( std::llabs( expected_bytes - bytes ), 2 + int64_t( double(expected_bytes) * 1e-12 ) );
+
+            const int64_t expected_core = m.double_sell( bytes );
+            const int64_t core_out = m.sell( bytes );
+            BOOST_REQUIRE_LE( std::llabs( expected_core - core_out ), 2 + int64_t( double(expected_core) * 1e-12 ) );
+         }
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE( stake_to_vote ) {
+   for( int64_t weeks = 0; weeks < 52 * 40; weeks += 3 ) {
+      for( int64_t staked : { 1ll, 10000ll, 123456789ll, 10000000000000ll, 1000000000000000000ll } ) {
+         const double expected = double_stake2vote( staked, weeks );
+         // staked * 2^fraction is truncated before the shift by whole years,
+         // weeks / 52 is already rounded in the double version
+         const double tolerance = std::exp2( weeks / 52 ) + expected * 1e-14;
+         BOOST_REQUIRE_LE( std::fabs( fixed_stake2vote( staked, weeks ) - expected ), tolerance );
+      }
+   }
+}
+
+BOOST_AUTO_TEST_CASE( week_weight_table ) {
+   for( int64_t k = 0; k < eosiosystem::weeks_per_year; ++k ) {
+      BOOST_REQUIRE( eosiosystem::week_weight_table.weight[k] == fixed_point::exp2( fixed_point::from_ratio( k, 52 ) ) );
+   }
+   for( int64_t weeks = 0; weeks < 52 * 40; weeks += 7 ) {
+      BOOST_REQUIRE_EQUAL( eosiosystem::vote_weight( 123456789ll, weeks ), fixed_stake2vote( 123456789ll, weeks ) );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( vote_weight_limits ) {
+   // past 63 whole years, where a shift by the years alone would be undefined
+   for( int64_t weeks : { 52ll * 62 + 51, 52ll * 63, 52ll * 63 + 51, 52ll * 64, 52ll * 126 + 13, 52ll * 200 } ) {
+      const double fraction_weight = double( eosiosystem::week_weight_table.weight[weeks % 52].mul_int( 123456789ll ) );
+      BOOST_REQUIRE_EQUAL( eosiosystem::vote_weight( 123456789ll, weeks ), fraction_weight * std::exp2( double( weeks / 52 ) ) );
+   }
+   // stakes around 2^62, the largest weight of a year
+   for( int64_t staked : { (int64_t(1) << 62) - 1, int64_t(1) << 62, (int64_t(1) << 62) + 1, INT64_MAX } ) {
+      const double expected = double_stake2vote( staked, 51 );
+      BOOST_REQUIRE( 0 < eosiosystem::vote_weight( staked, 51 ) );
+      BOOST_REQUIRE_LE( std::fabs( eosiosystem::vote_weight( staked, 51 ) - expected ), expected * 1e-14 );
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
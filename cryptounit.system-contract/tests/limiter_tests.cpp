@@ -0,0 +1,340 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/testing/tester.hpp>
+#include <eosio/chain/abi_serializer.hpp>
+#include "eosio.system_tester.hpp"
+
+#include "Runtime/Runtime.h"
+
+#include <fc/variant_object.hpp>
+
+using namespace eosio::testing;
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+using namespace fc;
+using namespace std;
+
+using mvo = fc::mutable_variant_object;
+
+// The limiter next to eosio.token, CRU issued by issuer. checklimit is pushed with the authority of
+// eosio.token, as its transfer sends it.
+class limiter_tester : public tester {
+public:
+
+   limiter_tester() {
+      produce_blocks( 2 );
+
+      create_accounts( { N(eosio.token), N(limiter), N(debtadmin), N(issuer), N(alice), N(bob), N(carol), N(dave) } );
+      produce_blocks( 2 );
+
+      set_code( N(eosio.token), contracts::token_wasm() );
+      set_abi( N(eosio.token), contracts::token_abi().data() );
+      set_code( N(limiter), contracts::limiter_wasm() );
+      set_abi( N(limiter), contracts::limiter_abi().data() );
+      produce_blocks();
+
+      const auto& accnt = control->db().get<account_object,by_name>( N(limiter) );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      abi_ser.set_abi(abi, abi_serializer_max_time);
+
+      base_tester::push_action( N(eosio.token), N(create), N(eosio.token), mvo()
+                                ("issuer", "issuer")
+                                ("maximum_supply", "1000000000.0000 CRU")
+      );
+      produce_blocks();
+   }
+
+   action_result push_action( const account_name& signer, const action_name &name, const variant_object &data ) {
+      string action_type_name = abi_ser.get_action_type(name);
+
+      action act;
+      act.account = N(limiter);
+      act.name    = name;
+      act.data    = abi_ser.variant_to_binary( action_type_name, data,abi_serializer_max_time );
+
+      return base_tester::push_action( std::move(act), uint64_t(signer));
+   }
+
+   // Data of the result action (batchresult, quotaresult) the pushed action sent inline
+   fc::variant push_for_result( const account_name& signer, const action_name &name, const variant_object &data, const action_name &result ) {
+      const auto trace = base_tester::push_action( N(limiter), name, signer, data );
+      std::function<const action_trace*( const action_trace& )> find = [&]( const action_trace& at ) -> const action_trace* {
+         if( at.act.account == N(limiter) && at.act.name == result ) {
+            return &at;
+         }
+         for( const auto& inline_trace : at.inline_traces ) {
+            if( const auto* found = find( inline_trace ) ) {
+               return found;
+            }
+         }
+         return nullptr;
+      };
+      for( const auto& at : trace->action_traces ) {
+         if( const auto* found = find( at ) ) {
+            return abi_ser.binary_to_variant( abi_ser.get_action_type( result ), found->act.data, abi_serializer_max_time );
+         }
+      }
+      BOOST_FAIL( "no " + result.to_string() + " in the trace" );
+      return fc::variant();
+   }
+
+   fc::variant batch( const account_name& signer, const action_name &name, const variant_object &data ) {
+      const auto r = push_for_result( signer, name, data, N(batchresult) );
+      BOOST_REQUIRE_EQUAL( name, r["action"].as<account_name>() );
+      return r;
+   }
+
+   action_result checklimit( account_name username, account_name to, const string& sum, const string& memo = "" ) {
+      return push_action( N(eosio.token), N(checklimit), mvo()
+           ( "username", username )
+           ( "to", to )
+           ( "sum", sum )
+           ( "memo", memo )
+      );
+   }
+
+   action_result adddebt( account_name debtor, account_name target, const string& debt, const string& memo ) {
+      return push_action( N(debtadmin), N(adddebt), mvo()
+           ( "debtor", debtor )
+           ( "target", target )
+           ( "debt", debt )
+           ( "memo", memo )
+      );
+   }
+
+   action_result addlimit( const string& limit ) {
+      return push_action( N(issuer), N(addlimit), mvo()( "limit", limit ) );
+   }
+
+   fc::variant get_row( account_name scope, account_name table, uint64_t primary_key, const string& type ) {
+      vector<char> data = get_row_by_account( N(limiter), scope, table, primary_key );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( type, data, abi_serializer_max_time );
+   }
+
+   fc::variant get_acctstate( account_name account ) {
+      return get_row( N(limiter), N(acctstate), account.value, "acctstate" );
+   }
+
+   fc::variant get_policy( account_name account ) {
+      return get_row( cru_code(), N(policy), account.value, "policy" );
+   }
+
+   static account_name cru_code() {
+      return account_name( symbol( 4, "CRU" ).to_symbol_code().value );
+   }
+
+   abi_serializer abi_ser;
+};
+
+BOOST_AUTO_TEST_SUITE(limiter_tests)
+
+BOOST_FIXTURE_TEST_CASE( batched_admin_actions, limiter_tester ) try {
+
+   auto require_batch = [&]( const fc::variant& r, uint32_t applied, uint32_t skipped ) {
+      BOOST_REQUIRE_EQUAL( applied, r["applied"].as<uint32_t>() );
+      BOOST_REQUIRE_EQUAL( skipped, r["skipped"].as<uint32_t>() );
+   };
+   auto whitelisted = [&]( account_name account ) {
+      return !get_row_by_account( N(limiter), cru_code(), N(whitelist), account ).empty();
+   };
+
+   // whitelists: entries already present, or absent for rmwhitelists, are skipped
+   require_batch( batch( N(issuer), N(addwhitelists), mvo()("currency_code", "CRU")("usernames", vector<account_name>{ N(alice), N(bob) }) ), 2, 0 );
+   require_batch( batch( N(issuer), N(addwhitelists), mvo()("currency_code", "CRU")("usernames", vector<account_name>{ N(bob), N(carol) }) ), 1, 1 );
+   BOOST_REQUIRE( whitelisted( N(alice) ) && whitelisted( N(bob) ) && whitelisted( N(carol) ) );
+   BOOST_REQUIRE_EQUAL( 1, get_policy( N(carol) )["flags"].as<uint32_t>() );
+   require_batch( batch( N(issuer), N(rmwhitelists), mvo()("currency_code", "CRU")("usernames", vector<account_name>{ N(alice), N(dave) }) ), 1, 1 );
+   BOOST_REQUIRE( !whitelisted( N(alice) ) );
+   BOOST_REQUIRE( get_policy( N(alice) ).is_null() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "missing authority either of token issuer or limiter" ),
+                        push_action( N(alice), N(addwhitelists), mvo()("currency_code", "CRU")("usernames", vector<account_name>{ N(alice) }) ) );
+
+   // locks, with the lock flag in acctstate
+   require_batch( batch( N(debtadmin), N(addlocks), mvo()("accounts", vector<account_name>{ N(alice), N(bob) })("note", "court order 17") ), 2, 0 );
+   require_batch( batch( N(debtadmin), N(addlocks), mvo()("accounts", vector<account_name>{ N(bob), N(carol) })("note", "court order 18") ), 1, 1 );
+   BOOST_REQUIRE_EQUAL( "court order 17", get_row( N(limiter), N(lock), N(bob), "lock" )["note"].as_string() );
+   BOOST_REQUIRE_EQUAL( 1, get_acctstate( N(carol) )["flags"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "empty note string" ),
+                        push_action( N(debtadmin), N(addlocks), mvo()("accounts", vector<account_name>{ N(dave) })("note", "") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "missing authority either of debtadmin or limiter" ),
+                        push_action( N(alice), N(addlocks), mvo()("accounts", vector<account_name>{ N(dave) })("note", "note") ) );
+
+   // debts, a debt with the key of one already registered is skipped
+   auto debt = []( account_name debtor, account_name target, const string& sum, const string& memo ) {
+      return mvo()("debtor", debtor)("target", target)("debt", sum)("memo", memo);
+   };
+   require_batch( batch( N(debtadmin), N(adddebts), mvo()("entries", vector<fc::variant>{
+      debt( N(dave), N(bob), "1.0000 CRU", "loan 1" ), debt( N(dave), N(bob), "2.0000 CRU", "loan 2" ) }) ), 2, 0 );
+   BOOST_REQUIRE_EQUAL( success(), adddebt( N(dave), N(carol), "3.0000 CRU", "loan 3" ) );
+   require_batch( batch( N(debtadmin), N(adddebts), mvo()("entries", vector<fc::variant>{
+      debt( N(dave), N(bob), "2.0000 CRU", "loan 2" ), debt( N(dave), N(carol), "3.0000 CRU", "loan 3" ), debt( N(dave), N(carol), "4.0000 CRU", "loan 4" ) }) ), 1, 2 );
+   BOOST_REQUIRE_EQUAL( 4, get_acctstate( N(dave) )["debt_count"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "empty memo string" ),
+                        push_action( N(debtadmin), N(adddebts), mvo()("entries", vector<fc::variant>{ debt( N(dave), N(bob), "5.0000 CRU", "" ) }) ) );
+
+   // a batch debt is returned like one added alone
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "Transfer valid for debt return only" ), checklimit( N(dave), N(bob), "1.5000 CRU", "loan 1" ) );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(dave), N(bob), "1.0000 CRU", "loan 1" ) );
+   BOOST_REQUIRE_EQUAL( 3, get_acctstate( N(dave) )["debt_count"].as<uint32_t>() );
+
+   // at most max_batch_size entries
+   vector<account_name> many;
+   for( uint32_t i = 0; i < 201; ++i ) {
+      many.emplace_back( "batch" + std::string( 1, char('a' + i / 26 / 26 % 26) ) + std::string( 1, char('a' + i / 26 % 26) ) + std::string( 1, char('a' + i % 26) ) );
+   }
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "too many entries" ),
+                        push_action( N(issuer), N(addwhitelists), mvo()("currency_code", "CRU")("usernames", many) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "too many entries" ),
+                        push_action( N(debtadmin), N(addlocks), mvo()("accounts", many)("note", "note") ) );
+   many.pop_back();
+   require_batch( batch( N(debtadmin), N(addlocks), mvo()("accounts", many)("note", "note") ), 200, 0 );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( rolling_window_limit, limiter_tester ) try {
+
+   auto setlimitmode = [&]( uint8_t mode ) {
+      return push_action( N(issuer), N(setlimitmode), mvo()("currency_code", "CRU")("mode", mode) );
+   };
+
+   BOOST_REQUIRE_EQUAL( success(), addlimit( "100.0000 CRU" ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "Limit mode is not changed" ), setlimitmode( 0 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "unknown limit mode" ), setlimitmode( 2 ) );
+   BOOST_REQUIRE_EQUAL( success(), setlimitmode( 1 ) );
+
+   // 60 on day d and 30 on day d + 1, kept as daily buckets in the policy row
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(bob), "60.0000 CRU" ) );
+   produce_block( fc::days(1) );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(bob), "30.0000 CRU" ) );
+   auto p = get_policy( N(alice) );
+   BOOST_REQUIRE_EQUAL( 90'0000, p["used_amount"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( 30, p["window"].get_array().size() );
+
+   const auto exceeded = wasm_assert_msg( "Token transfer limit exceeded, max transfer in 30 days 100.0000 CRU, used 90.0000 CRU, possible 10.0000 CRU" );
+   BOOST_REQUIRE_EQUAL( exceeded, checklimit( N(alice), N(bob), "20.0000 CRU" ) );
+
+   // day d + 29 still has both, on day d + 30 the 60 has left the window
+   produce_block( fc::days(28) );
+   BOOST_REQUIRE_EQUAL( exceeded, checklimit( N(alice), N(bob), "20.0000 CRU" ) );
+   produce_block( fc::days(1) );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(bob), "20.0000 CRU" ) );
+   BOOST_REQUIRE_EQUAL( 50'0000, get_policy( N(alice) )["used_amount"].as<int64_t>() );
+
+   // a window idle for longer than 30 days starts empty
+   produce_block( fc::days(45) );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(bob), "100.0000 CRU" ) );
+   BOOST_REQUIRE_EQUAL( 100'0000, get_policy( N(alice) )["used_amount"].as<int64_t>() );
+
+   // switching back to calendar months drops the usage
+   BOOST_REQUIRE_EQUAL( success(), setlimitmode( 0 ) );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(bob), "100.0000 CRU" ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "Token transfer limit exceeded, max month transfer 100.0000 CRU, used 100.0000 CRU, possible 0.0000 CRU" ),
+                        checklimit( N(alice), N(bob), "1.0000 CRU" ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( getquota_reports_without_changing_state, limiter_tester ) try {
+
+   auto getquota = [&]( account_name account ) {
+      const auto r = push_for_result( account, N(getquota), mvo()("account", account)("sym", "4,CRU"), N(quotaresult) );
+      BOOST_REQUIRE_EQUAL( account, r["account"].as<account_name>() );
+      produce_block();
+      return r;
+   };
+
+   // no limit for CRU
+   auto q = getquota( N(alice) );
+   BOOST_REQUIRE( !q["limited"].as<bool>() );
+   BOOST_REQUIRE_EQUAL( int64_t( asset::max_amount ), q["remaining"].as<asset>().get_amount() );
+
+   BOOST_REQUIRE_EQUAL( success(), addlimit( "100.0000 CRU" ) );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(bob), "60.0000 CRU" ) );
+   q = getquota( N(alice) );
+   BOOST_REQUIRE( q["limited"].as<bool>() );
+   BOOST_REQUIRE_EQUAL( asset::from_string("40.0000 CRU"), q["remaining"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( 60'0000, get_policy( N(alice) )["used_amount"].as<int64_t>() );
+
+   // an account without a policy row gets none
+   q = getquota( N(bob) );
+   BOOST_REQUIRE_EQUAL( asset::from_string("100.0000 CRU"), q["remaining"].as<asset>() );
+   BOOST_REQUIRE( get_policy( N(bob) ).is_null() );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(issuer), N(addwhitelist), mvo()("username", "carol")("currency_code", "CRU") ) );
+   BOOST_REQUIRE( !getquota( N(carol) )["limited"].as<bool>() );
+
+   // lock and debts as counted in acctstate
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(debtadmin), N(addlock), mvo()("account", "dave")("note", "court order 17") ) );
+   BOOST_REQUIRE_EQUAL( success(), adddebt( N(dave), N(bob), "1.0000 CRU", "loan 1" ) );
+   BOOST_REQUIRE_EQUAL( success(), adddebt( N(dave), N(bob), "2.0000 CRU", "loan 2" ) );
+   q = getquota( N(dave) );
+   BOOST_REQUIRE( q["is_locked"].as<bool>() );
+   BOOST_REQUIRE_EQUAL( 2, q["debt_count"].as<uint32_t>() );
+   q = getquota( N(alice) );
+   BOOST_REQUIRE( !q["is_locked"].as<bool>() );
+   BOOST_REQUIRE_EQUAL( 0, q["debt_count"].as<uint32_t>() );
+
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(dave), N(bob), "1.0000 CRU", "loan 1" ) );
+   BOOST_REQUIRE_EQUAL( 1, getquota( N(dave) )["debt_count"].as<uint32_t>() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( gcdebts_removes_expired_debts, limiter_tester ) try {
+
+   auto setdebtexp = [&]( account_name signer, account_name debtor, uint64_t debt_id, uint32_t seconds_from_now ) {
+      return push_action( signer, N(setdebtexp), mvo()
+                          ("debtor", debtor)
+                          ("debt_id", debt_id)
+                          ("expires_at", time_point_sec( control->head_block_time() ) + seconds_from_now)
+      );
+   };
+   auto gcdebts = [&]( uint32_t max_rows ) {
+      const auto r = push_action( N(carol), N(gcdebts), mvo()("max_rows", max_rows) );
+      produce_block();
+      return r;
+   };
+   auto has_debt = [&]( account_name debtor, uint64_t debt_id ) {
+      return !get_row_by_account( N(limiter), debtor, N(debt), debt_id ).empty();
+   };
+
+   // alice: debt 0 expires in an hour, debt 1 is removed before it expires
+   BOOST_REQUIRE_EQUAL( success(), adddebt( N(alice), N(bob), "1.0000 CRU", "loan 1" ) );
+   BOOST_REQUIRE_EQUAL( success(), adddebt( N(alice), N(bob), "2.0000 CRU", "loan 2" ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "missing authority either of debtadmin or limiter" ), setdebtexp( N(alice), N(alice), 0, 3600 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "expiry must be in the future" ), setdebtexp( N(debtadmin), N(alice), 0, 0 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "debt not found" ), setdebtexp( N(debtadmin), N(alice), 2, 3600 ) );
+   BOOST_REQUIRE_EQUAL( success(), setdebtexp( N(debtadmin), N(alice), 0, 3600 ) );
+   BOOST_REQUIRE_EQUAL( success(), setdebtexp( N(debtadmin), N(alice), 1, 3600 ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(debtadmin), N(rmdebt), mvo()("debtor", "alice")("debt_id", 1) ) );
+
+   // dave: the expiry is moved from one hour to three
+   BOOST_REQUIRE_EQUAL( success(), adddebt( N(dave), N(bob), "3.0000 CRU", "loan 3" ) );
+   BOOST_REQUIRE_EQUAL( success(), setdebtexp( N(debtadmin), N(dave), 0, 3600 ) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( success(), setdebtexp( N(debtadmin), N(dave), 0, 3 * 3600 ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no expired debts" ), gcdebts( 10 ) );
+   produce_block( fc::hours(2) );
+
+   // an expired debt restricts the debtor like any other until gcdebts has removed it
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "Transfer valid for debt return only" ), checklimit( N(alice), N(carol), "5.0000 CRU" ) );
+
+   // one queue entry per call: debt 0 of alice, then the entry of the removed debt 1
+   BOOST_REQUIRE_EQUAL( success(), gcdebts( 1 ) );
+   BOOST_REQUIRE( !has_debt( N(alice), 0 ) );
+   BOOST_REQUIRE( get_acctstate( N(alice) ).is_null() );
+   BOOST_REQUIRE_EQUAL( success(), checklimit( N(alice), N(carol), "5.0000 CRU" ) );
+   BOOST_REQUIRE_EQUAL( success(), gcdebts( 1 ) );
+
+   // dave's debt is not due before its new expiry
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no expired debts" ), gcdebts( 10 ) );
+   BOOST_REQUIRE( has_debt( N(dave), 0 ) );
+   produce_block( fc::hours(1) );
+   BOOST_REQUIRE_EQUAL( success(), gcdebts( 10 ) );
+   BOOST_REQUIRE( !has_debt( N(dave), 0 ) );
+   BOOST_REQUIRE( get_acctstate( N(dave) ).is_null() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no expired debts" ), gcdebts( 10 ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,156 @@
+// Debt key construction: the v1 string key of calcDebtHash against pack_debt_key.
+//   debtkey_bench --check   layout check of pack_debt_key, exit code 1 on mismatch
+//   debtkey_bench           layout check, then ns per key of both
+// Only the key is built: sha256 is a host intrinsic on chain and costs about the same for both keys,
+// name/asset to_string and the string concatenation run in WASM.
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "debtkey.hpp"
+
+// eosio::name::to_string
+static std::string name_to_string( uint64_t value )
+{
+	static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+	std::string str( 13, '.' );
+	uint64_t tmp = value;
+	for( uint32_t i = 0; i <= 12; ++i ) {
+		char c = charmap[tmp & ( i == 0 ? 0x0f : 0x1f )];
+		str[12 - i] = c;
+		tmp >>= ( i == 0 ? 4 : 5 );
+	}
+	const auto last = str.find_last_not_of( '.' );
+	return str.substr( 0, last + 1 );
+}
+
+// eosio::asset::to_string
+static std::string asset_to_string( int64_t amount, uint64_t symbol )
+{
+	const uint8_t precision = uint8_t( symbol & 0xff );
+	const bool negative = amount < 0;
+	uint64_t abs_amount = negative ? uint64_t( -amount ) : uint64_t( amount );
+	char buffer[32];
+	char* end = buffer + sizeof( buffer );
+	char* p = end;
+	for( uint8_t i = 0; i < precision; ++i ) {
+		*--p = char( '0' + abs_amount % 10 );
+		abs_amount /= 10;
+	}
+	if( precision > 0 ) {
+		*--p = '.';
+	}
+	do {
+		*--p = char( '0' + abs_amount % 10 );
+		abs_amount /= 10;
+	} while( abs_amount > 0 );
+	if( negative ) {
+		*--p = '-';
+	}
+	std::string code;
+	for( uint64_t sym = symbol >> 8; sym > 0; sym >>= 8 ) {
+		code += char( sym & 0xff );
+	}
+	return std::string( p, end ) + " " + code;
+}
+
+struct sample_debt {
+	uint64_t debtor;
+	uint64_t target;
+	int64_t amount;
+	uint64_t symbol;
+	std::string memo;
+};
+
+static size_t v1_key( const sample_debt &d )
+{
+	std::string key =
+		name_to_string( d.debtor ) +
+		name_to_string( d.target ) +
+		asset_to_string( d.amount, d.symbol ) +
+		d.memo;
+	return key.size() + uint8_t( key[key.size() / 2] );
+}
+
+static size_t v2_key( const sample_debt &d )
+{
+	char key[debt_key_buffer_size];
+	const uint32_t size = pack_debt_key( key, d.debtor, d.target, d.amount, d.symbol, d.memo.data(), d.memo.size() );
+	return size + uint8_t( key[size / 2] );
+}
+
+static bool check()
+{
+	// "alice"_n, "bob"_n, 1.2345 CRU, "x"
+	const uint64_t alice = 0x345c850000000000ull;
+	const uint64_t bob = 0x3d0e000000000000ull;
+	const uint64_t cru = ( uint64_t( 'U' ) << 24 ) | ( uint64_t( 'R' ) << 16 ) | ( uint64_t( 'C' ) << 8 ) | 4;
+	const unsigned char expected[] = {
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x85, 0x5c, 0x34,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x3d,
+		0x39, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x04, 0x43, 0x52, 0x55, 0x00, 0x00, 0x00, 0x00,
+		0x01, 'x'
+	};
+	char key[debt_key_buffer_size];
+	const uint32_t size = pack_debt_key( key, alice, bob, 12345, cru, "x", 1 );
+	if( size != sizeof( expected ) || std::memcmp( key, expected, size ) != 0 ) {
+		std::printf( "pack_debt_key layout mismatch\n" );
+		return false;
+	}
+	if( name_to_string( alice ) + name_to_string( bob ) + asset_to_string( 12345, cru ) != "alicebob1.2345 CRU" ) {
+		std::printf( "v1 key mismatch\n" );
+		return false;
+	}
+
+	// 300 byte memo: two byte size prefix, does not fit the stack buffer
+	std::string memo( 300, 'm' );
+	std::vector<char> big( debt_key_size( 300 ) );
+	if( pack_debt_key( big.data(), alice, bob, 1, cru, memo.data(), 300 ) != 32 + 2 + 300
+			|| uint8_t( big[32] ) != 0xac || uint8_t( big[33] ) != 0x02 ) {
+		std::printf( "varuint32 size prefix mismatch\n" );
+		return false;
+	}
+	std::printf( "pack_debt_key matches the eosio::pack layout\n" );
+	return true;
+}
+
+template<typename F>
+static double ns_per_key( F f, const sample_debt* debts, size_t count, uint32_t iterations )
+{
+	volatile size_t sink = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for( uint32_t i = 0; i < iterations; ++i ) {
+		sink = sink + f( debts[i % count] );
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>( elapsed ).count() / iterations;
+}
+
+int main( int argc, char** argv )
+{
+	if( ! check() ) {
+		return 1;
+	}
+	if( argc > 1 && std::strcmp( argv[1], "--check" ) == 0 ) {
+		return 0;
+	}
+
+	const uint64_t cru = ( uint64_t( 'U' ) << 24 ) | ( uint64_t( 'R' ) << 16 ) | ( uint64_t( 'C' ) << 8 ) | 4;
+	const sample_debt debts[] = {
+		{ 0x345c850000000000ull, 0x3d0e000000000000ull, 12345, cru, "loan 1" },
+		{ 0x4a8f93264e980000ull, 0x8ba4ecaae0000000ull, 1000000000, cru, "repayment of the march invoice, ref 2019-03-117" },
+		{ 0x345c850000000000ull, 0x4a8f93264e980000ull, 7, cru, std::string( 200, 'r' ) },
+	};
+	const size_t count = sizeof( debts ) / sizeof( debts[0] );
+
+	const uint32_t iterations = 5000000;
+	std::printf( "v1 string key: %.2f ns/key\n", ns_per_key( v1_key, debts, count, iterations ) );
+	std::printf( "v2 packed key: %.2f ns/key\n", ns_per_key( v2_key, debts, count, iterations ) );
+	return 0;
+}
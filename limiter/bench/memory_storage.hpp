@@ -0,0 +1,246 @@
+#pragma once
+
+// In-memory stand-in for the limiter tables behind check_transfer, for native benchmarks.
+// Every method makes the same table calls as limiter::table_storage and counts them in ops, so the
+// counts are those checklimit would do on chain. Debts are matched by their packed key rather than its
+// sha256, and all debts are assumed to carry the v2 key. Also the read-only view limiter_state_changes,
+// the in-process check of eosio.token, runs over.
+
+#include <stdint.h>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "debtkey.hpp"
+#include "transfer_check.hpp"
+
+struct db_ops {
+	uint64_t find = 0;
+	uint64_t lower_bound = 0;	// also multi_index begin()
+	uint64_t next = 0;
+	uint64_t emplace = 0;
+	uint64_t modify = 0;
+	uint64_t erase = 0;
+
+	uint64_t total() const {
+		return find + lower_bound + next + emplace + modify + erase;
+	}
+};
+
+struct transfer_failed : std::runtime_error {
+	using std::runtime_error::runtime_error;
+};
+
+class memory_storage {
+public:
+	// LIMITER_ACCOUNT_STATE of the modelled build
+	bool account_state_rows = false;
+	db_ops ops;
+
+	struct acctstate {
+		uint8_t flags = 0;
+		uint32_t debt_count = 0;
+	};
+	enum account_flags : uint8_t {
+		locked = 1
+	};
+
+	std::unordered_set<uint64_t> locks;
+	std::unordered_map<uint64_t, acctstate> states;
+	std::unordered_map<uint64_t, std::vector<std::string>> debts;	// by debtor, packed keys
+	std::unordered_map<uint64_t, limit_state> limits;
+	std::map<uint64_t, std::unordered_map<uint64_t, policy_state>> policies;	// by code, by account
+	std::map<uint64_t, std::unordered_set<uint64_t>> whitelists;
+	std::map<uint64_t, std::unordered_set<uint64_t>> whiteliststo;
+	std::map<uint64_t, std::unordered_map<uint64_t, int64_t>> usedlimits;
+
+	// the transfer about to be checked, for take_debt
+	void begin_transfer( uint64_t from, uint64_t to, int64_t amount, uint64_t symbol, const std::string &memo ) {
+		char key[debt_key_buffer_size];
+		const uint32_t size = pack_debt_key( key, from, to, amount, symbol, memo.data(), memo.size() );
+		transfer_key.assign( key, size );
+	}
+
+	// limiter::adddebt and addlock
+	void add_debt( uint64_t debtor, uint64_t target, int64_t amount, uint64_t symbol, const std::string &memo ) {
+		char key[debt_key_buffer_size];
+		const uint32_t size = pack_debt_key( key, debtor, target, amount, symbol, memo.data(), memo.size() );
+		debts[debtor].emplace_back( key, size );
+		++states[debtor].debt_count;
+	}
+	void add_lock( uint64_t account ) {
+		locks.insert( account );
+		states[account].flags |= locked;
+	}
+
+	// a lock or debt from before acctstate, without a row
+	void add_legacy_lock( uint64_t account ) {
+		locks.insert( account );
+	}
+	void add_legacy_debt( uint64_t debtor, uint64_t target, int64_t amount, uint64_t symbol, const std::string &memo ) {
+		char key[debt_key_buffer_size];
+		const uint32_t size = pack_debt_key( key, debtor, target, amount, symbol, memo.data(), memo.size() );
+		debts[debtor].emplace_back( key, size );
+	}
+
+	// limiter::syncaccts for one account: a row from the lock table and the debt scope, if it has none
+	void sync_account( uint64_t account ) {
+		if( states.count( account ) ) {
+			return;
+		}
+		acctstate state;
+		state.flags = locks.count( account ) ? locked : 0;
+		auto d = debts.find( account );
+		state.debt_count = d != debts.end() ? d->second.size() : 0;
+		if( state.flags != 0 || state.debt_count != 0 ) {
+			states[account] = state;
+		}
+	}
+
+	void account_state( uint64_t account, bool &is_locked, bool &has_debts ) {
+		if( account_state_rows ) {
+			++ops.find;
+			auto state = states.find( account );
+			if( state != states.end() ) {
+				is_locked = ( state->second.flags & locked ) != 0;
+				has_debts = state->second.debt_count > 0;
+			}
+			return;
+		}
+		++ops.find;
+		is_locked = locks.count( account ) > 0;
+		++ops.lower_bound;
+		auto d = debts.find( account );
+		has_debts = d != debts.end() && ! d->second.empty();
+	}
+
+	bool take_debt( uint64_t debtor ) {
+		++ops.find;	// byhash
+		auto &keys = debts[debtor];
+		for( auto it = keys.begin(); it != keys.end(); ++it ) {
+			if( *it == transfer_key ) {
+				// update_account_state: find, modify or erase; without LIMITER_ACCOUNT_STATE a missing row
+				// is seeded from the lock table and the debt scope
+				++ops.find;
+				if( ! account_state_rows ) {
+					sync_account( debtor );
+				}
+				auto &state = states[debtor];
+				--state.debt_count;
+				if( state.flags == 0 && state.debt_count == 0 ) {
+					states.erase( debtor );
+					++ops.erase;
+				} else {
+					++ops.modify;
+				}
+				keys.erase( it );
+				++ops.erase;
+				return true;
+			}
+		}
+		++ops.find;	// v1 hash fallback
+		return false;
+	}
+
+	uint8_t symbol_flags( uint64_t code ) {
+		return symbol_policy::flags_of( code );
+	}
+
+	bool find_limit( uint64_t code, limit_state &limit ) {
+		++ops.find;
+		auto it = limits.find( code );
+		if( it == limits.end() ) {
+			return false;
+		}
+		limit = it->second;
+		return true;
+	}
+
+	bool whitelisted_to( uint64_t code, uint64_t account, const limit_state &limit ) {
+		++ops.find;
+		auto &rows = policies[code];
+		auto it = rows.find( account );
+		if( it != rows.end() ) {
+			return ( it->second.flags & ::whitelisted_to ) != 0;
+		}
+		if( limit.policy_synced ) {
+			return false;
+		}
+		++ops.find;
+		return whiteliststo[code].count( account ) > 0;
+	}
+
+	// read-only, for limiter_state_changes as eosio.token runs it
+	bool whitelisted( uint64_t code, uint64_t account, const limit_state &limit ) {
+		++ops.find;
+		auto &rows = policies[code];
+		auto it = rows.find( account );
+		if( it != rows.end() ) {
+			return ( it->second.flags & ::whitelisted ) != 0;
+		}
+		if( limit.policy_synced ) {
+			return false;
+		}
+		++ops.find;
+		return whitelists[code].count( account ) > 0;
+	}
+
+	policy_state &from_policy( uint64_t code, uint64_t account ) {
+		++ops.find;
+		auto &rows = policies[code];
+		auto it = rows.find( account );
+		if( it == rows.end() ) {
+			it = rows.emplace( account, seed_policy( code, account ) ).first;
+		}
+		from_row = &it->second;
+		from_state = *from_row;
+		return from_state;
+	}
+
+	void store_policy( uint64_t, policy_state &p ) {
+		++ops.modify;
+		*from_row = std::move( p );
+	}
+
+	void fail( const char *msg ) {
+		throw transfer_failed( msg );
+	}
+
+	void limit_exceeded( const limit_state &, int64_t ) {
+		throw transfer_failed( "Token transfer limit exceeded" );
+	}
+
+private:
+	std::string transfer_key;
+	policy_state *from_row = nullptr;
+	policy_state from_state;
+
+	// limiter::seed_policy: legacy_policy, then drop the usedlimit row and emplace
+	policy_state seed_policy( uint64_t code, uint64_t account ) {
+		policy_state p;
+		ops.find += 4;	// whitelist, whitelistto, usedlimit, tokenlimit for the generation
+		if( whitelists[code].count( account ) ) {
+			p.flags |= ::whitelisted;
+		}
+		if( whiteliststo[code].count( account ) ) {
+			p.flags |= ::whitelisted_to;
+		}
+		auto &used = usedlimits[code];
+		auto u = used.find( account );
+		++ops.find;
+		if( u != used.end() ) {
+			p.used_amount = u->second;
+			used.erase( u );
+			++ops.erase;
+		}
+		p.period = current_period( 0 );
+		auto l = limits.find( code );
+		p.generation = l != limits.end() ? l->second.generation : 0;
+		++ops.emplace;
+		return p;
+	}
+};
@@ -0,0 +1,76 @@
+// month_index against __secs_to_tm, the calendar code it replaced in checklimit.
+//   period_bench --check   exhaustive equivalence over 1970-2100, exit code 1 on mismatch
+//   period_bench           equivalence check, then ns per call of both
+
+#include <stdint.h>
+#include <time.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "tm.h"
+#include "period.hpp"
+
+static uint32_t reference_month_index( uint32_t utc_secs )
+{
+	tm t;
+	__secs_to_tm( utc_secs, &t );
+	return uint32_t( ( t.tm_year - 70 ) * 12 + t.tm_mon );
+}
+
+static bool check()
+{
+	const uint32_t end = 4133980800u;	// 2101-01-01
+	uint64_t checked = 0;
+
+	// every hour, and both sides of every midnight
+	for( uint32_t t = 0; t < end; t += 3600 ) {
+		const uint32_t samples[] = { t, t + 1799 };
+		for( uint32_t s : samples ) {
+			if( month_index( s ) != reference_month_index( s ) ) {
+				std::printf( "mismatch at %u: %u != %u\n", s, month_index( s ), reference_month_index( s ) );
+				return false;
+			}
+			++checked;
+		}
+		if( t % 86400 == 0 && t > 0 ) {
+			if( month_index( t - 1 ) != reference_month_index( t - 1 ) ) {
+				std::printf( "mismatch at %u\n", t - 1 );
+				return false;
+			}
+			++checked;
+		}
+	}
+	std::printf( "month_index matches __secs_to_tm on %llu timestamps\n", (unsigned long long)checked );
+	return true;
+}
+
+template<typename F>
+static double ns_per_call( F f, uint32_t iterations )
+{
+	volatile uint32_t sink = 0;
+	const auto start = std::chrono::steady_clock::now();
+	uint32_t t = 1600000000u;
+	for( uint32_t i = 0; i < iterations; ++i ) {
+		sink = sink + f( t );
+		t += 7919;
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>( elapsed ).count() / iterations;
+}
+
+int main( int argc, char** argv )
+{
+	if( ! check() ) {
+		return 1;
+	}
+	if( argc > 1 && std::strcmp( argv[1], "--check" ) == 0 ) {
+		return 0;
+	}
+
+	const uint32_t iterations = 20000000;
+	std::printf( "__secs_to_tm: %.2f ns/call\n", ns_per_call( reference_month_index, iterations ) );
+	std::printf( "month_index:  %.2f ns/call\n", ns_per_call( month_index, iterations ) );
+	return 0;
+}
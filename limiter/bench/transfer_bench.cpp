@@ -0,0 +1,362 @@
+// check_transfer, the checklimit logic, over memory_storage.
+//   transfer_bench --check   decision checks on a few transfers, exit code 1 on failure
+//   transfer_bench           decision checks, then ns and table calls per transfer for each checklimit path,
+//                            with and without acctstate rows (LIMITER_ACCOUNT_STATE)
+// The checks also run limiter_state_changes, the in-process check of eosio.token, against check_transfer.
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "memory_storage.hpp"
+
+using symbol_policy::symbol_code_raw;
+
+static const uint64_t cru = symbol_code_raw( "CRU" );	// month limit
+static const uint64_t usd = symbol_code_raw( "USD" );	// rolling window limit
+static const uint64_t eur = symbol_code_raw( "EUR" );	// no limit
+static const uint64_t untb = symbol_code_raw( "UNTB" );
+
+static uint64_t symbol_raw( uint64_t code )
+{
+	return code << 8 | 4;
+}
+
+static const uint32_t start_time = 1700000000u;
+
+// true if the transfer is accepted
+static bool transfer( memory_storage &db, uint64_t from, uint64_t to, uint64_t code, int64_t amount, uint32_t utc_secs,
+		const std::string &memo = "" )
+{
+	db.begin_transfer( from, to, amount, symbol_raw( code ), memo );
+	try {
+		check_transfer( db, from, to, code, amount, utc_secs );
+		return true;
+	} catch( const transfer_failed & ) {
+		return false;
+	}
+}
+
+static bool check()
+{
+	bool ok = true;
+	auto expect = [&]( bool condition, const char *what ) {
+		if( ! condition ) {
+			std::printf( "failed: %s\n", what );
+			ok = false;
+		}
+	};
+
+	for( bool rows : { false, true } ) {
+		memory_storage db;
+		db.account_state_rows = rows;
+		db.limits[cru] = limit_state{ 1000, 0, calendar_month };
+		db.limits[usd] = limit_state{ 1000, 0, rolling_window };
+
+		const uint32_t t = start_time;
+		expect( transfer( db, 1, 2, cru, 600, t ), "transfer within the month limit" );
+		expect( ! transfer( db, 1, 2, cru, 500, t ), "transfer over the month limit" );
+		expect( transfer( db, 1, 2, cru, 400, t ), "transfer up to the month limit" );
+		expect( transfer( db, 1, 2, cru, 1000, t + 31 * 86400 ), "month limit in the next month" );
+		expect( transfer( db, 1, 2, eur, 5000, t ), "currency without limit" );
+		expect( transfer( db, 1, 2, untb, 5000, t ), "UNTB" );
+
+		db.whiteliststo[cru].insert( 3 );
+		expect( transfer( db, 1, 3, cru, 5000, t + 31 * 86400 ), "legacy whitelistto target" );
+		db.limits[cru].policy_synced = true;
+		db.policies[cru][3].flags = whitelisted_to;
+		expect( transfer( db, 1, 3, cru, 5000, t + 31 * 86400 ), "synced whitelistto target" );
+		db.whiteliststo[cru].insert( 9 );
+		expect( ! transfer( db, 1, 9, cru, 5000, t + 31 * 86400 ), "legacy table not read once synced" );
+		db.limits[cru].policy_synced = false;
+		db.policies[cru][4].flags = whitelisted;
+		expect( transfer( db, 4, 2, cru, 5000, t ), "whitelisted sender" );
+
+		expect( transfer( db, 5, 2, usd, 1000, t ), "rolling window limit" );
+		expect( ! transfer( db, 5, 2, usd, 1, t + 29 * 86400 ), "rolling window keeps 30 days" );
+		expect( transfer( db, 5, 2, usd, 1000, t + 30 * 86400 ), "rolling window drops the oldest day" );
+
+		db.add_lock( 6 );
+		expect( ! transfer( db, 6, 2, eur, 1, t ), "locked account" );
+
+		db.add_debt( 7, 8, 50, symbol_raw( eur ), "loan" );
+		expect( ! transfer( db, 7, 2, eur, 1, t ), "debtor transfer other than the return" );
+		expect( transfer( db, 7, 8, eur, 50, t, "loan" ), "debt return" );
+		expect( transfer( db, 7, 2, eur, 1, t ), "transfer after the debt is returned" );
+
+		// a lock and debts from before acctstate: read by the probe, by acctstate rows only after syncaccts
+		db.add_legacy_lock( 20 );
+		db.add_legacy_debt( 21, 8, 50, symbol_raw( eur ), "old loan" );
+		db.add_legacy_debt( 22, 8, 50, symbol_raw( eur ), "old loan" );
+		expect( transfer( db, 20, 2, eur, 1, t ) == rows, "legacy lock before syncaccts" );
+		expect( transfer( db, 21, 2, eur, 1, t ) == rows, "legacy debtor before syncaccts" );
+		if( ! rows ) {
+			expect( transfer( db, 22, 8, eur, 50, t, "old loan" ), "legacy debt return before syncaccts" );
+			expect( db.states.count( 22 ) == 0, "row of the legacy debtor seeded and dropped with the return" );
+		}
+		for( uint64_t account : { 2, 20, 21 } ) {
+			db.sync_account( account );
+		}
+		expect( db.states.count( 2 ) == 0, "no row for an account without lock or debt" );
+		expect( ! transfer( db, 20, 2, eur, 1, t ), "legacy lock after syncaccts" );
+		expect( ! transfer( db, 21, 2, eur, 1, t ), "legacy debtor after syncaccts" );
+		expect( transfer( db, 21, 8, eur, 50, t, "old loan" ), "legacy debt return after syncaccts" );
+		expect( db.states.count( 21 ) == 0, "row dropped with the last debt" );
+	}
+	if( ok ) {
+		std::printf( "check_transfer decisions are as expected\n" );
+	}
+	return ok;
+}
+
+enum class in_process {
+	fails,		// the transfer fails in eosio.token
+	accepts,	// checklimit is not dispatched
+	dispatches
+};
+
+// limiter_state_changes over a copy of db
+static in_process in_process_check( memory_storage db, uint64_t from, uint64_t to, uint64_t code )
+{
+	try {
+		return limiter_state_changes( db, from, to, code ) ? in_process::dispatches : in_process::accepts;
+	} catch( const transfer_failed & ) {
+		return in_process::fails;
+	}
+}
+
+static int64_t used_amount_of( memory_storage &db, uint64_t code, uint64_t account )
+{
+	auto &rows = db.policies[code];
+	auto it = rows.find( account );
+	return it != rows.end() ? it->second.used_amount : 0;
+}
+
+// Whether limiter_state_changes agrees with check_transfer on a copy of db: a transfer it fails must fail
+// checklimit with the same message, one it accepts must pass checklimit without a debt being taken or the
+// sender's used amount changing. Dispatched transfers are decided by checklimit itself.
+static bool agrees_with_checklimit( const memory_storage &state, uint64_t from, uint64_t to, uint64_t code, int64_t amount,
+		uint32_t utc_secs, const std::string &memo = "" )
+{
+	memory_storage view = state;
+	std::string in_process_error;
+	bool changes = false;
+	try {
+		changes = limiter_state_changes( view, from, to, code );
+	} catch( const transfer_failed &e ) {
+		in_process_error = e.what();
+	}
+
+	memory_storage db = state;
+	db.begin_transfer( from, to, amount, symbol_raw( code ), memo );
+	std::string checklimit_error;
+	try {
+		check_transfer( db, from, to, code, amount, utc_secs );
+	} catch( const transfer_failed &e ) {
+		checklimit_error = e.what();
+	}
+
+	if( ! in_process_error.empty() ) {
+		return in_process_error == checklimit_error;
+	}
+	if( changes ) {
+		return true;
+	}
+	memory_storage before = state;
+	return checklimit_error.empty() && db.debts[from] == before.debts[from]
+			&& used_amount_of( db, code, from ) == used_amount_of( before, code, from );
+}
+
+// Senders: 10 locked, 11 indebted to 12, 13 whitelisted by policy row, 14 on the legacy whitelist only,
+// 15 limited with 900 of 1000 used. Recipients: 16 whitelisted by policy row, 17 on the legacy whitelistto only.
+static bool check_in_process()
+{
+	bool ok = true;
+	auto expect = [&]( bool condition, const char *what ) {
+		if( ! condition ) {
+			std::printf( "failed: %s\n", what );
+			ok = false;
+		}
+	};
+
+	const uint32_t t = start_time;
+	memory_storage db;
+	db.limits[cru] = limit_state{ 1000, 0, calendar_month };
+	db.add_lock( 10 );
+	db.add_debt( 11, 12, 50, symbol_raw( cru ), "loan" );
+	db.policies[cru][13].flags = whitelisted;
+	db.whitelists[cru].insert( 14 );
+	db.policies[cru][15].used_amount = 900;
+	db.policies[cru][15].period = current_period( t );
+	db.policies[cru][16].flags = whitelisted_to;
+	db.whiteliststo[cru].insert( 17 );
+
+	struct transfer_case {
+		const char *what;
+		uint64_t from;
+		uint64_t to;
+		uint64_t code;
+		int64_t amount;
+		const char *memo;
+		in_process expected;
+	};
+	const transfer_case cases[] = {
+		{ "in process: locked sender", 10, 2, cru, 1, "", in_process::fails },
+		{ "in process: locked sender, currency without limit", 10, 2, eur, 1, "", in_process::fails },
+		{ "in process: locked sender, UNTB", 10, 2, untb, 1, "", in_process::fails },
+		{ "in process: debt return", 11, 12, cru, 50, "loan", in_process::dispatches },
+		{ "in process: debtor transfer other than the return", 11, 2, cru, 1, "", in_process::dispatches },
+		{ "in process: whitelisted sender", 13, 2, cru, 5000, "", in_process::accepts },
+		{ "in process: legacy whitelisted sender", 14, 2, cru, 5000, "", in_process::accepts },
+		{ "in process: limited sender within the limit", 15, 2, cru, 100, "", in_process::dispatches },
+		{ "in process: limited sender over the limit", 15, 2, cru, 101, "", in_process::dispatches },
+		{ "in process: limited sender to a whitelisted recipient", 15, 16, cru, 5000, "", in_process::accepts },
+		{ "in process: limited sender to a legacy whitelisted recipient", 15, 17, cru, 5000, "", in_process::accepts },
+		{ "in process: limited sender, currency without limit", 15, 2, eur, 5000, "", in_process::accepts },
+		{ "in process: limited sender, UNTB", 15, 2, untb, 5000, "", in_process::accepts },
+		{ "in process: sender without policy row", 2, 3, cru, 1, "", in_process::dispatches },
+	};
+	for( bool synced : { false, true } ) {
+		// once synced the legacy rows have policy rows of their own
+		if( synced ) {
+			db.limits[cru].policy_synced = true;
+			db.policies[cru][14].flags = whitelisted;
+			db.policies[cru][17].flags = whitelisted_to;
+		}
+		for( const auto &c : cases ) {
+			expect( in_process_check( db, c.from, c.to, c.code ) == c.expected, c.what );
+			expect( agrees_with_checklimit( db, c.from, c.to, c.code, c.amount, t, c.memo ), c.what );
+		}
+	}
+	if( ok ) {
+		std::printf( "limiter_state_changes agrees with check_transfer\n" );
+	}
+	return ok;
+}
+
+struct path {
+	const char *name;
+	// sets up the storage for count transfers, returns the transfer of iteration i
+	std::function<void( memory_storage &, uint32_t count )> setup;
+	std::function<bool( memory_storage &, uint32_t i )> run;
+};
+
+static void run_path( const path &p, bool rows, uint32_t count )
+{
+	memory_storage db;
+	db.account_state_rows = rows;
+	p.setup( db, count );
+	db.ops = db_ops();
+
+	uint32_t accepted = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for( uint32_t i = 0; i < count; ++i ) {
+		accepted += p.run( db, i );
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	const double ns = std::chrono::duration<double, std::nano>( elapsed ).count() / count;
+
+	const double n = count;
+	std::printf( "%-17s %-9s %8.1f %8.2f %6.2f %6.2f %6.2f %6.2f %6.2f %8.1f%%\n", p.name, rows ? "acctstate" : "probe", ns,
+			db.ops.total() / n, db.ops.find / n, db.ops.lower_bound / n, db.ops.emplace / n, db.ops.modify / n, db.ops.erase / n,
+			100.0 * accepted / n );
+}
+
+int main( int argc, char** argv )
+{
+	if( ! check() || ! check_in_process() ) {
+		return 1;
+	}
+	if( argc > 1 && std::strcmp( argv[1], "--check" ) == 0 ) {
+		return 0;
+	}
+
+	const uint32_t accounts = 100000;
+	auto account = []( uint32_t i ) { return uint64_t( 1000 + i % accounts ); };
+	auto seed_accounts = [&]( memory_storage &db, uint64_t code ) {
+		auto &rows = db.policies[code];
+		for( uint32_t i = 0; i < accounts; ++i ) {
+			rows[account( i )];
+		}
+	};
+	auto plain = []( memory_storage &db, uint32_t ) {
+		db.limits[cru] = limit_state{ INT64_MAX / 2, 0, calendar_month };
+	};
+
+	const path paths[] = {
+		{ "UNTB", plain, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), account( i + 1 ), untb, 1, start_time );
+		}},
+		{ "no limit", plain, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), account( i + 1 ), eur, 1, start_time );
+		}},
+		{ "whitelisted to", [&]( memory_storage &db, uint32_t count ) {
+			plain( db, count );
+			db.policies[cru][1].flags = whitelisted_to;
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, cru, 1, start_time );
+		}},
+		{ "whitelisted from", [&]( memory_storage &db, uint32_t count ) {
+			plain( db, count );
+			for( uint32_t i = 0; i < accounts; ++i ) {
+				db.policies[cru][account( i )].flags = whitelisted;
+			}
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, cru, 1, start_time );
+		}},
+		{ "month limit", [&]( memory_storage &db, uint32_t count ) {
+			plain( db, count );
+			seed_accounts( db, cru );
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, cru, 1, start_time + i / 64 );
+		}},
+		{ "month, synced", [&]( memory_storage &db, uint32_t count ) {
+			plain( db, count );
+			db.limits[cru].policy_synced = true;
+			seed_accounts( db, cru );
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, cru, 1, start_time + i / 64 );
+		}},
+		{ "rolling window", [&]( memory_storage &db, uint32_t ) {
+			db.limits[usd] = limit_state{ INT64_MAX / 2, 0, rolling_window };
+			seed_accounts( db, usd );
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, usd, 1, start_time + i / 64 );
+		}},
+		{ "limit exceeded", [&]( memory_storage &db, uint32_t ) {
+			db.limits[cru] = limit_state{ 1, 0, calendar_month };
+			seed_accounts( db, cru );
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, cru, 2, start_time );
+		}},
+		{ "locked", [&]( memory_storage &db, uint32_t ) {
+			for( uint32_t i = 0; i < accounts; ++i ) {
+				db.add_lock( account( i ) );
+			}
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, eur, 1, start_time );
+		}},
+		{ "debt return", [&]( memory_storage &db, uint32_t count ) {
+			for( uint32_t i = 0; i < count; ++i ) {
+				db.add_debt( account( i ), 1, 1 + i / accounts, symbol_raw( eur ), "debt" );
+			}
+		}, [&]( memory_storage &db, uint32_t i ) {
+			return transfer( db, account( i ), 1, eur, 1 + i / accounts, start_time, "debt" );
+		}},
+	};
+
+	const uint32_t count = 2000000;
+	std::printf( "%u transfers per path, %u accounts\n", count, accounts );
+	std::printf( "%-17s %-9s %8s %8s %6s %6s %6s %6s %6s %9s\n", "path", "account", "ns", "db ops", "find", "lbound",
+			"emplace", "modify", "erase", "accepted" );
+	for( const auto &p : paths ) {
+		for( bool rows : { false, true } ) {
+			run_path( p, rows, count );
+		}
+	}
+	return 0;
+}
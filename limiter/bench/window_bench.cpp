@@ -0,0 +1,99 @@
+// advance_window/add_to_window against a sum over the transfer log of the last 30 days.
+//   window_bench --check   randomized equivalence check, exit code 1 on mismatch
+//   window_bench           equivalence check, then ns per transfer of both
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <utility>
+
+#include "window.hpp"
+
+struct ring {
+	int64_t buckets[rolling_window_buckets] = {};
+	int64_t total = 0;
+	uint32_t newest = 0;
+
+	int64_t transfer( uint32_t day, int64_t amount ) {
+		advance_window( buckets, total, newest, day );
+		add_to_window( buckets, total, newest, amount );
+		return total;
+	}
+};
+
+// keeps every transfer of the window and sums them, what a per-transfer scan would cost
+struct transfer_log {
+	std::deque<std::pair<uint32_t, int64_t>> transfers;
+
+	int64_t transfer( uint32_t day, int64_t amount ) {
+		transfers.emplace_back( day, amount );
+		while( transfers.front().first + rolling_window_buckets <= day ) {
+			transfers.pop_front();
+		}
+		int64_t total = 0;
+		for( const auto &t : transfers ) {
+			total += t.second;
+		}
+		return total;
+	}
+};
+
+static bool check()
+{
+	std::mt19937 rng( 7 );
+	for( int account = 0; account < 1000; ++account ) {
+		ring r;
+		transfer_log log;
+		uint32_t day = 18000 + rng() % 1000;
+		r.newest = day;
+		for( int i = 0; i < 200; ++i ) {
+			// mostly same or next day, sometimes a gap longer than the window
+			const uint32_t gap = rng() % 10;
+			day += gap < 5 ? 0 : gap < 9 ? rng() % 5 : rng() % 60;
+			const int64_t amount = 1 + rng() % 100000;
+			const int64_t expected = log.transfer( day, amount );
+			const int64_t actual = r.transfer( day, amount );
+			if( expected != actual ) {
+				std::printf( "mismatch on day %u: %lld != %lld\n", day, (long long)actual, (long long)expected );
+				return false;
+			}
+		}
+	}
+	std::printf( "rolling window matches the transfer log\n" );
+	return true;
+}
+
+template<typename T>
+static double ns_per_transfer( uint32_t transfers_per_day, uint32_t days )
+{
+	T t;
+	volatile int64_t sink = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for( uint32_t day = 1; day <= days; ++day ) {
+		for( uint32_t i = 0; i < transfers_per_day; ++i ) {
+			sink = sink + t.transfer( day, 1 );
+		}
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>( elapsed ).count() / ( double( transfers_per_day ) * days );
+}
+
+int main( int argc, char** argv )
+{
+	if( ! check() ) {
+		return 1;
+	}
+	if( argc > 1 && std::strcmp( argv[1], "--check" ) == 0 ) {
+		return 0;
+	}
+
+	for( uint32_t per_day : { 1u, 10u, 100u } ) {
+		std::printf( "%3u transfers/day: ring %.2f ns/transfer, log scan %.2f ns/transfer\n", per_day,
+				ns_per_transfer<ring>( per_day, 3650 ), ns_per_transfer<transfer_log>( per_day, 3650 ) );
+	}
+	return 0;
+}
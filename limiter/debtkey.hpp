@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Binary debt key: the eosio::pack() layout of (name debtor, name target, asset debt, string memo),
+// which is also the action data of adddebt, deldebt and checklimit.
+//   debtor u64 | target u64 | amount i64 | symbol u64 | varuint32 memo size | memo bytes
+// Little endian, as in WASM.
+
+// Longest memo eosio.token accepts; longer keys are still valid but are built on the heap
+constexpr uint32_t debt_key_memo_max = 256;
+constexpr uint32_t debt_key_fixed_size = 8 + 8 + 8 + 8;
+constexpr uint32_t debt_key_buffer_size = debt_key_fixed_size + 5 + debt_key_memo_max;
+
+constexpr uint32_t debt_key_size( uint32_t memo_size )
+{
+	uint32_t varint_size = 1;
+	for( uint32_t v = memo_size; v >= 0x80; v >>= 7 ) {
+		++varint_size;
+	}
+	return debt_key_fixed_size + varint_size + memo_size;
+}
+
+// Writes the key into out, which must hold debt_key_size( memo_size ) bytes; returns the key size
+inline uint32_t pack_debt_key( char *out, uint64_t debtor, uint64_t target, int64_t amount, uint64_t symbol,
+		const char *memo, uint32_t memo_size )
+{
+	char *p = out;
+	memcpy( p, &debtor, 8 ); p += 8;
+	memcpy( p, &target, 8 ); p += 8;
+	memcpy( p, &amount, 8 ); p += 8;
+	memcpy( p, &symbol, 8 ); p += 8;
+	uint32_t v = memo_size;
+	do {
+		uint8_t b = uint8_t( v & 0x7f );
+		v >>= 7;
+		b |= uint8_t( ( v > 0 ) << 7 );
+		*p++ = char( b );
+	} while( v > 0 );
+	memcpy( p, memo, memo_size );
+	return uint32_t( p - out ) + memo_size;
+}
+
+static_assert( debt_key_size( 0 ) == 33, "empty memo" );
+static_assert( debt_key_size( 127 ) == 33 + 127, "one byte varint" );
+static_assert( debt_key_size( 128 ) == 34 + 128, "two byte varint" );
+static_assert( debt_key_size( debt_key_memo_max ) <= debt_key_buffer_size, "buffer fits the longest token memo" );
@@ -1,5 +1,4 @@
 #include "limiter.hpp"
-#include "tm.h"
 
 //using namespace eosio;
 
@@ -16,6 +15,7 @@
 	auto it = locks.find( account.value ) ;
 	if( it == locks.end() ) {
 		eosio::check( note.size() > 0, "empty note string" );
+		update_account_state( account, 0, locked, 0, ram_payer );
 		locks.emplace( ram_payer, [&](auto &a) {
 			a.account = account;
 			a.ts = eosio::time_point_sec( eosio::current_time_point() );
@@ -30,6 +30,36 @@
 	}
 }
 
+// Locks accounts not locked yet with the same note, already locked accounts keep their note
+[[eosio::action]] void limiter::addlocks( std::vector<eosio::name> accounts, std::string note )
+{
+	eosio::name ram_payer = _debtadmin;
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( _debtadmin ) ) {
+		eosio::check( false, "missing authority either of debtadmin or limiter" );
+	}
+	eosio::check( accounts.size() <= max_batch_size, "too many entries" );
+	eosio::check( note.size() > 0, "empty note string" );
+
+	lock_index locks( _self, _self.value );
+	const eosio::time_point_sec ct( eosio::current_time_point() );
+	uint32_t applied = 0;
+	for( auto account : accounts ) {
+		if( locks.find( account.value ) != locks.end() ) {
+			continue;
+		}
+		update_account_state( account, 0, locked, 0, ram_payer );
+		locks.emplace( ram_payer, [&](auto &a) {
+			a.account = account;
+			a.ts = ct;
+			a.note = note;
+		});
+		++applied;
+	}
+	report_batch( "addlocks"_n, applied, accounts.size() - applied );
+}
+
 [[eosio::action]] void limiter::rmlock( eosio::name account )
 {
 	eosio::check( has_auth( _debtadmin ) || has_auth( _self ),
@@ -38,9 +68,11 @@
 	lock_index lockstable( _self, _self.value );
 	const auto &it = lockstable.find( account.value );
 	eosio::check( it != lockstable.end(), "Account not locked" );
+	update_account_state( account, 0, 0, locked, _self );
 	lockstable.erase( it );
 }
 
+// v1 key, rows added before calcDebtHashV2 keep it until rehashdebt has run for the debtor
 eosio::checksum256 limiter::calcDebtHash( eosio::name debtor, eosio::name target, eosio::asset debt, std::string memo )
 {
 	std::string key =
@@ -51,6 +83,34 @@ eosio::checksum256 limiter::calcDebtHash( eosio::name debtor, eosio::name target
 	return eosio::sha256( key.c_str(), key.size() );
 }
 
+eosio::checksum256 limiter::calcDebtHashV2( eosio::name debtor, eosio::name target, const eosio::asset &debt, const std::string &memo )
+{
+	const uint32_t size = debt_key_size( memo.size() );
+	if( size > debt_key_buffer_size ) {
+		std::vector<char> key( size );
+		pack_debt_key( key.data(), debtor.value, target.value, debt.amount, debt.symbol.raw(), memo.data(), memo.size() );
+		return eosio::sha256( key.data(), size );
+	}
+	char key[debt_key_buffer_size];
+	pack_debt_key( key, debtor.value, target.value, debt.amount, debt.symbol.raw(), memo.data(), memo.size() );
+	return eosio::sha256( key, size );
+}
+
+// calcDebtHashV2 of the current action, for actions taking ( name debtor, name target, asset debt, string memo ):
+// their action data already is the packed key
+eosio::checksum256 limiter::actionDebtHash()
+{
+	const uint32_t size = eosio::action_data_size();
+	if( size > debt_key_buffer_size ) {
+		std::vector<char> key( size );
+		eosio::read_action_data( key.data(), size );
+		return eosio::sha256( key.data(), size );
+	}
+	char key[debt_key_buffer_size];
+	eosio::read_action_data( key, size );
+	return eosio::sha256( key, size );
+}
+
 [[eosio::action]] void limiter::adddebt( eosio::name debtor, eosio::name target, eosio::asset debt, std::string memo )
 {
 	eosio::name ram_payer = _debtadmin;
@@ -61,13 +121,20 @@ eosio::checksum256 limiter::calcDebtHash( eosio::name debtor, eosio::name target
 	}
 
 	eosio::check( debt.amount > 0, "valid positive debt amount only" );
-	debt_index debts( _self, debtor.value );
-
 	eosio::check( memo.length() > 0, "empty memo string" );
-	eosio::checksum256 hash = calcDebtHash ( debtor, target, debt, memo );
+	eosio::check( add_debt_row( debtor, target, debt, memo, actionDebtHash(), ram_payer ), "Debt hash is not unique" );
+}
+
+// Emplaces a debt row unless a debt with the same v2 or v1 hash exists
+bool limiter::add_debt_row( eosio::name debtor, eosio::name target, const eosio::asset &debt, const std::string &memo,
+		const eosio::checksum256 &hash, eosio::name ram_payer )
+{
+	debt_index debts( _self, debtor.value );
 	auto idx = debts.template get_index<"byhash"_n>();
-	auto itr = idx.find( hash );
-	eosio::check( itr == idx.end(), "Debt hash is not unique" );
+	if( idx.find( hash ) != idx.end() || idx.find( calcDebtHash( debtor, target, debt, memo ) ) != idx.end() ) {
+		return false;
+	}
+	update_account_state( debtor, 1, 0, 0, ram_payer );
 	debts.emplace( ram_payer, [&](auto &a) {
 		a.id = debts.available_primary_key();
 		a.target = target;
@@ -76,6 +143,28 @@ eosio::checksum256 limiter::calcDebtHash( eosio::name debtor, eosio::name target
 		a.memo = memo;
 		a.hash = hash;
 	});
+	return true;
+}
+
+[[eosio::action]] void limiter::adddebts( std::vector<debt_entry> entries )
+{
+	eosio::name ram_payer = _debtadmin;
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( _debtadmin ) ) {
+		eosio::check( false, "missing authority either of debtadmin or limiter" );
+	}
+	eosio::check( entries.size() <= max_batch_size, "too many entries" );
+
+	uint32_t applied = 0;
+	for( const auto &e : entries ) {
+		eosio::check( e.debt.amount > 0, "valid positive debt amount only" );
+		eosio::check( e.memo.length() > 0, "empty memo string" );
+		if( add_debt_row( e.debtor, e.target, e.debt, e.memo, calcDebtHashV2( e.debtor, e.target, e.debt, e.memo ), ram_payer ) ) {
+			++applied;
+		}
+	}
+	report_batch( "adddebts"_n, applied, entries.size() - applied );
 }
 
 [[eosio::action]] void limiter::deldebt( eosio::name debtor, eosio::name target, eosio::asset debt, std::string memo )
@@ -84,11 +173,14 @@ eosio::checksum256 limiter::calcDebtHash( eosio::name debtor, eosio::name target
 			"missing authority either of debtadmin or limiter" );
 
 	debt_index debts( _self, debtor.value );
-	eosio::checksum256 hash = calcDebtHash ( debtor, target, debt, memo );
 	auto idx = debts.template get_index<"byhash"_n>();
-	auto itr = idx.find( hash );
+	auto itr = idx.find( actionDebtHash() );
+	if( itr == idx.end() ) {
+		itr = idx.find( calcDebtHash( debtor, target, debt, memo ) );
+	}
 	eosio::check( itr != idx.end(), "Debt not found" );
 
+	update_account_state( debtor, -1, 0, 0, _self );
 	idx.erase( itr );
 }
 
@@ -100,9 +192,225 @@ eosio::checksum256 limiter::calcDebtHash( eosio::name debtor, eosio::name target
 	const auto &it = debts.find( debt_id );
 	eosio::check( it != debts.end(), "debt not found" );
 
+	update_account_state( debtor, -1, 0, 0, _self );
 	debts.erase( it );
 }
 
+// Sets or moves the expiry of a debt; the debt is removed by gcdebts once it has passed. checklimit does not
+// look at expires_at, an expired debt binds the debtor until gcdebts has removed it.
+[[eosio::action]] void limiter::setdebtexp( eosio::name debtor, uint64_t debt_id, eosio::time_point_sec expires_at )
+{
+	eosio::name ram_payer = _debtadmin;
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( _debtadmin ) ) {
+		eosio::check( false, "missing authority either of debtadmin or limiter" );
+	}
+
+	debt_index debts( _self, debtor.value );
+	const auto &it = debts.find( debt_id );
+	eosio::check( it != debts.end(), "debt not found" );
+	eosio::check( expires_at > eosio::time_point_sec( eosio::current_time_point() ), "expiry must be in the future" );
+
+	debts.modify( it, eosio::same_payer, [&](auto &c) {
+		c.expires_at.emplace( expires_at );
+	});
+
+	debtexpiry_index queue( _self, _self.value );
+	auto bydebt = queue.template get_index<"bydebt"_n>();
+	auto entry = bydebt.find( uint128_t( debtor.value ) << 64 | debt_id );
+	if( entry != bydebt.end() ) {
+		bydebt.modify( entry, eosio::same_payer, [&](auto &c) {
+			c.expires_at = expires_at;
+		});
+	} else {
+		queue.emplace( ram_payer, [&](auto &c) {
+			c.id = queue.available_primary_key();
+			c.debtor = debtor;
+			c.debt_id = debt_id;
+			c.expires_at = expires_at;
+		});
+	}
+}
+
+// Removes up to max_rows expired debts, oldest expiry first. Anyone can run it; the RAM goes back to the payers.
+[[eosio::action]] void limiter::gcdebts( uint32_t max_rows )
+{
+	eosio::check( max_rows > 0, "max_rows must be positive" );
+
+	const eosio::time_point_sec ct( eosio::current_time_point() );
+	debtexpiry_index queue( _self, _self.value );
+	auto byexpiry = queue.template get_index<"byexpiry"_n>();
+
+	uint32_t removed = 0;
+	for( auto entry = byexpiry.begin(); entry != byexpiry.end() && entry->expires_at <= ct && removed < max_rows; ++removed ) {
+		debt_index debts( _self, entry->debtor.value );
+		auto it = debts.find( entry->debt_id );
+		if( it != debts.end() && it->expires_at.has_value() && it->expires_at.value() == entry->expires_at ) {
+			update_account_state( entry->debtor, -1, 0, 0, _self );
+			debts.erase( it );
+		}
+		entry = byexpiry.erase( entry );
+	}
+	eosio::check( removed > 0, "no expired debts" );
+}
+
+uint32_t limiter::count_debts( eosio::name debtor )
+{
+	debt_index debts( _self, debtor.value );
+	uint32_t count = 0;
+	for( auto it = debts.begin(); it != debts.end(); ++it ) {
+		++count;
+	}
+	return count;
+}
+
+// Lock flag and debt count of an account as its lock row and debt scope have them
+void limiter::scan_account_state( eosio::name account, uint8_t &flags, uint32_t &debt_count )
+{
+	lock_index locks( _self, _self.value );
+	flags = locks.find( account.value ) != locks.end() ? locked : 0;
+	debt_count = count_debts( account );
+}
+
+// Writes the acctstate row of an account, erasing it when there is neither a lock nor a debt
+void limiter::store_account_state( acctstate_index &states, acctstate_index::const_iterator it, eosio::name account,
+		uint8_t flags, uint32_t debt_count, eosio::name ram_payer )
+{
+	if( flags == 0 && debt_count == 0 ) {
+		if( it != states.end() ) {
+			states.erase( it );
+		}
+	} else if( it != states.end() ) {
+		states.modify( it, eosio::same_payer, [&](auto &c) {
+			c.flags = flags;
+			c.debt_count = debt_count;
+		});
+	} else {
+		states.emplace( ram_payer, [&](auto &c) {
+			c.account = account;
+			c.flags = flags;
+			c.debt_count = debt_count;
+		});
+	}
+}
+
+// Applies a change to the acctstate row of an account, to be called before the lock or debt table is changed.
+// Until LIMITER_ACCOUNT_STATE is on, a missing row is seeded from the lock table and the debt scope, for
+// accounts locked or indebted before acctstate. Once syncaccts has covered those, a missing row means
+// neither and the scan is skipped.
+void limiter::update_account_state( eosio::name account, int32_t debt_delta, uint8_t set_flags, uint8_t clear_flags, eosio::name ram_payer )
+{
+	acctstate_index states( _self, _self.value );
+	auto it = states.find( account.value );
+
+	uint8_t flags = 0;
+	uint32_t debt_count = 0;
+	if( it != states.end() ) {
+		flags = it->flags;
+		debt_count = it->debt_count;
+	}
+#if ! LIMITER_ACCOUNT_STATE
+	else {
+		scan_account_state( account, flags, debt_count );
+	}
+#endif
+
+	flags = ( flags | set_flags ) & ~clear_flags;
+	eosio::check( debt_delta >= 0 || debt_count >= uint32_t( -debt_delta ), "debt count underflow" );
+	debt_count += debt_delta;
+
+	store_account_state( states, it, account, flags, debt_count, ram_payer );
+}
+
+// Rebuilds the acctstate row of an account from the lock table and its debt scope
+[[eosio::action]] void limiter::syncacct( eosio::name account )
+{
+	eosio::name ram_payer = _debtadmin;
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( _debtadmin ) ) {
+		eosio::check( false, "missing authority either of debtadmin or limiter" );
+	}
+
+	acctstate_index states( _self, _self.value );
+	uint8_t flags = 0;
+	uint32_t debt_count = 0;
+	scan_account_state( account, flags, debt_count );
+	store_account_state( states, states.find( account.value ), account, flags, debt_count, ram_payer );
+}
+
+// Seeds the acctstate rows of accounts that have none, the migration before LIMITER_ACCOUNT_STATE=1.
+// Accounts with a row are skipped, so batches can be sent again; one without a lock or debt gets no row.
+[[eosio::action]] void limiter::syncaccts( std::vector<eosio::name> accounts )
+{
+	eosio::name ram_payer = _debtadmin;
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( _debtadmin ) ) {
+		eosio::check( false, "missing authority either of debtadmin or limiter" );
+	}
+	eosio::check( accounts.size() <= max_batch_size, "too many entries" );
+
+	acctstate_index states( _self, _self.value );
+	uint32_t applied = 0;
+	for( auto account : accounts ) {
+		auto it = states.find( account.value );
+		if( it != states.end() ) {
+			continue;
+		}
+		uint8_t flags = 0;
+		uint32_t debt_count = 0;
+		scan_account_state( account, flags, debt_count );
+		if( flags == 0 && debt_count == 0 ) {
+			continue;
+		}
+		store_account_state( states, it, account, flags, debt_count, ram_payer );
+		++applied;
+	}
+	report_batch( "syncaccts"_n, applied, accounts.size() - applied );
+}
+
+// Rewrites v1 debt hashes of a debtor to v2, visiting at most max_rows rows per call, debt ids from from_id on.
+// Rows already on v2 count against max_rows too, so later batches start further on with from_id.
+[[eosio::action]] void limiter::rehashdebt( eosio::name debtor, uint32_t max_rows, eosio::binary_extension<uint64_t> from_id )
+{
+	eosio::check( has_auth( _debtadmin ) || has_auth( _self ), "missing authority either of debtadmin or limiter" );
+	eosio::check( max_rows > 0, "max_rows must be positive" );
+
+	debt_index debts( _self, debtor.value );
+	uint32_t visited = 0;
+	for( auto it = debts.lower_bound( from_id.value_or( 0 ) ); it != debts.end() && visited < max_rows; ++it, ++visited ) {
+		const eosio::checksum256 hash = calcDebtHashV2( debtor, it->target, it->sum, it->memo );
+		if( it->hash == hash ) {
+			continue;
+		}
+		eosio::check( it->hash == calcDebtHash( debtor, it->target, it->sum, it->memo ), "unknown debt hash" );
+		debts.modify( it, eosio::same_payer, [&](auto &c) {
+			c.hash = hash;
+		});
+	}
+}
+
+// symbol_policy flags of a currency, with the eosio.token symrule override applied when enabled
+uint8_t limiter::symbol_flags( eosio::symbol_code currency_code )
+{
+	if( currency_code.raw() == _flags_cache_code ) {
+		return _flags_cache;
+	}
+	uint8_t flags = symbol_policy::flags_of( currency_code.raw() );
+#if SYMBOL_RULE_OVERRIDES
+	token_symrules rules( _eosiotoken, _eosiotoken.value );
+	auto it = rules.find( currency_code.raw() );
+	if( it != rules.end() ) {
+		flags = ( flags | it->set_flags ) & ~it->clear_flags;
+	}
+#endif
+	_flags_cache_code = currency_code.raw();
+	_flags_cache = flags;
+	return flags;
+}
+
 eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 {
 	stats statstable( "eosio.token"_n, currency_code.raw() );
@@ -123,7 +431,7 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 		eosio::check( false, "missing authority either of token issuer or limiter" );
 	}
 
-	eosio::check( currency_code != _untb_symbol_code, "UNTB limit is not supported" );
+	eosio::check( !( symbol_flags( currency_code ) & symbol_policy::limit_exempt ), currency_code.to_string() + " limit is not supported" );
 
 	tokenlimit_index limits_table(_self, _self.value);
 	auto token_limit = limits_table.find( currency_code.raw() );
@@ -131,9 +439,11 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 	eosio::time_point_sec ct( eosio::current_time_point() );
 
 	if ( token_limit == limits_table.end() ) {
+		// a new limit starts from zero usage, also after rmlimit
 		limits_table.emplace( ram_payer, [&](auto &c) {
 			c.month_limit = limit;
 			c.ts = ct;
+			c.generation.emplace( ct.utc_seconds );
 		});
 	} else {
 		limits_table.modify( token_limit, ram_payer, [&](auto &c) {
@@ -155,6 +465,52 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 	table.erase (pos);
 }
 
+// Drops the used amounts of all accounts at once, rows are brought up to date when next touched.
+[[eosio::action]] void limiter::resetused( eosio::symbol_code currency_code )
+{
+	eosio::check( has_auth( get_issuer( currency_code ) ) || has_auth( _self ),
+			"missing authority either of token issuer or limiter" );
+
+	tokenlimit_index limits_table( _self, _self.value );
+	auto token_limit = limits_table.find( currency_code.raw() );
+	eosio::check( token_limit != limits_table.end(), "Limit does not set" );
+
+	eosio::time_point_sec ct( eosio::current_time_point() );
+	const uint32_t generation = token_limit->generation.value_or( 0 );
+
+	limits_table.modify( token_limit, eosio::same_payer, [&](auto &c) {
+		c.generation.emplace( ct.utc_seconds > generation ? ct.utc_seconds : generation + 1 );
+	});
+}
+
+// Switches between calendar month and rolling window limits. Usage counted under the previous mode is dropped.
+[[eosio::action]] void limiter::setlimitmode( eosio::symbol_code currency_code, uint8_t mode )
+{
+	eosio::check( has_auth( get_issuer( currency_code ) ) || has_auth( _self ),
+			"missing authority either of token issuer or limiter" );
+	eosio::check( mode == calendar_month || mode == rolling_window, "unknown limit mode" );
+
+	tokenlimit_index limits_table( _self, _self.value );
+	auto token_limit = limits_table.find( currency_code.raw() );
+	eosio::check( token_limit != limits_table.end(), "Limit does not set" );
+	eosio::check( token_limit->mode.value_or( calendar_month ) != mode, "Limit mode is not changed" );
+
+	eosio::time_point_sec ct( eosio::current_time_point() );
+	const uint32_t generation = token_limit->generation.value_or( 0 );
+
+	limits_table.modify( token_limit, eosio::same_payer, [&](auto &c) {
+		c.generation.emplace( ct.utc_seconds > generation ? ct.utc_seconds : generation + 1 );
+		c.mode.emplace( mode );
+	});
+}
+
+uint32_t limiter::limit_generation( eosio::symbol_code currency_code )
+{
+	tokenlimit_index limits_table( _self, _self.value );
+	auto token_limit = limits_table.find( currency_code.raw() );
+	return token_limit != limits_table.end() ? token_limit->generation.value_or( 0 ) : 0;
+}
+
 [[eosio::action]] void limiter::rmusedlimit( eosio::symbol_code currency_code, eosio::name user )
 {
 	eosio::check( has_auth( user ) || has_auth( get_issuer(currency_code) ) || has_auth( _self ),
@@ -164,26 +520,211 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 	auto iter_tokenlimit = tokenlimits.find( currency_code.raw() );
 	eosio::check( iter_tokenlimit == tokenlimits.end(), "Limit is active" );
 
+	bool found = false;
+
 	usedlimit_index usedlimits_table( _self, currency_code.raw() );
 	auto itr = usedlimits_table.find( user.value );
-	eosio::check( itr != usedlimits_table.end(), "Used limit not found" );
-	usedlimits_table.erase( itr );
+	if( itr != usedlimits_table.end() ) {
+		usedlimits_table.erase( itr );
+		found = true;
+	}
+
+	policy_index policies( _self, currency_code.raw() );
+	auto pos = policies.find( user.value );
+	if( pos != policies.end() ) {
+		found = clear_used_amount( policies, pos ) || found;
+	}
+
+	eosio::check( found, "Used limit not found" );
 }
 
-[[eosio::action]] void limiter::rmusedlimits( eosio::symbol_code currency_code, uint32_t user_count )
+[[eosio::action]] void limiter::rmusedlimits( eosio::symbol_code currency_code, uint32_t user_count, eosio::binary_extension<eosio::name> from )
 {
 	eosio::check(  has_auth( _self ) || has_auth( get_issuer(currency_code) ),
 			"missing authority either of token issuer or limiter" );
 
+	uint32_t i = 0;
+	uint32_t cleared = 0;
+
 	usedlimit_index usedlimits_table( _self, currency_code.raw() );
-	auto itr = usedlimits_table.begin();
-	eosio::check( itr != usedlimits_table.end(), "Used limit(s) not found" );
+	for( auto itr = usedlimits_table.begin(); itr != usedlimits_table.end() && i < user_count; ++i, ++cleared ) {
+		itr = usedlimits_table.erase( itr );
+	}
+
+	// every visited row counts against user_count, whitelist-only rows included, so the walk stays bounded;
+	// rows that keep their flags stay in place, later batches start further on with from
+	policy_index policies( _self, currency_code.raw() );
+	for( auto itr = policies.lower_bound( from.value_or( eosio::name() ).value ); itr != policies.end() && i < user_count; ++i ) {
+		auto next = std::next( itr );
+		if( clear_used_amount( policies, itr ) ) {
+			++cleared;
+		}
+		itr = next;
+	}
+
+	// a batch used up on rows without a used amount is not an error, the next page may have some
+	eosio::check( cleared > 0 || i == user_count, "Used limit(s) not found" );
+}
+
+bool limiter::clear_used_amount( policy_index &policies, policy_index::const_iterator it )
+{
+	if( it->used_amount == 0 ) {
+		return false;
+	}
+	if( it->flags == 0 ) {
+		policies.erase( it );
+	} else {
+		policies.modify( it, eosio::same_payer, [&](auto &p) {
+			p.used_amount = 0;
+			p.window.clear();
+		});
+	}
+	return true;
+}
+
+// Policy row of an account as given by the legacy whitelist/whitelistto/usedlimit rows, not stored
+limiter::policy limiter::legacy_policy( eosio::symbol_code currency_code, eosio::name account )
+{
+	policy p;
+	p.account = account;
+
+	whitelist_index whitelists_table( _self, currency_code.raw() );
+	if( whitelists_table.find( account.value ) != whitelists_table.end() ) {
+		p.flags |= whitelisted;
+	}
+
+	whitelistto_index whiteliststo_table( _self, currency_code.raw() );
+	if( whiteliststo_table.find( account.value ) != whiteliststo_table.end() ) {
+		p.flags |= whitelisted_to;
+	}
+
+	usedlimit_index usedlimits_table( _self, currency_code.raw() );
+	auto used_limit = usedlimits_table.find( account.value );
+	if( used_limit != usedlimits_table.end() ) {
+		p.used_amount = used_limit->used_limit.amount;
+		p.ts = used_limit->ts;
+	}
+
+	p.period = current_period( p.ts.utc_seconds );
+	p.generation = limit_generation( currency_code );
+	return p;
+}
+
+// Creates the policy row of an account from the legacy whitelist/whitelistto/usedlimit rows.
+// Once a policy row exists it is authoritative, the legacy usedlimit row is dropped.
+limiter::policy_index::const_iterator limiter::seed_policy( policy_index &policies, eosio::symbol_code currency_code, eosio::name account, eosio::name ram_payer )
+{
+	const policy seeded = legacy_policy( currency_code, account );
+
+	usedlimit_index usedlimits_table( _self, currency_code.raw() );
+	auto used_limit = usedlimits_table.find( account.value );
+	if( used_limit != usedlimits_table.end() ) {
+		usedlimits_table.erase( used_limit );
+	}
+
+	return policies.emplace( ram_payer, [&](auto &p) {
+		p = seeded;
+	});
+}
+
+limit_state limiter::limit_of( const tokenlimit &limit )
+{
+	limit_state l;
+	l.limit = limit.month_limit.amount;
+	l.generation = limit.generation.value_or( 0 );
+	l.mode = limit.mode.value_or( calendar_month );
+	l.policy_synced = limit.policy_synced.value_or( false );
+	return l;
+}
+
+policy_state limiter::state_of( const policy &p )
+{
+	policy_state st;
+	st.flags = p.flags;
+	st.used_amount = p.used_amount;
+	st.period = p.period;
+	st.generation = p.generation;
+	st.ts = p.ts.utc_seconds;
+	st.window = p.window;
+	return st;
+}
+
+void limiter::set_policy_flag( eosio::symbol_code currency_code, eosio::name account, uint8_t flag, bool value, eosio::name ram_payer )
+{
+	policy_index policies( _self, currency_code.raw() );
+	auto it = policies.find( account.value );
+	if( it == policies.end() ) {
+		it = seed_policy( policies, currency_code, account, ram_payer );
+	}
+
+	uint8_t flags = value ? ( it->flags | flag ) : ( it->flags & ~flag );
+	if( flags == 0 && ( it->used_amount == 0 || it->generation != limit_generation( currency_code ) )) {
+		policies.erase( it );
+	} else if( flags != it->flags ) {
+		policies.modify( it, eosio::same_payer, [&](auto &p) {
+			p.flags = flags;
+		});
+	}
+}
 
+[[eosio::action]] void limiter::syncpolicy( eosio::symbol_code currency_code, eosio::name from, uint32_t max_rows )
+{
+	eosio::name ram_payer = get_issuer( currency_code );
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( ram_payer )) {
+		eosio::check( false, "missing authority either of token issuer or limiter" );
+	}
+
+	policy_index policies( _self, currency_code.raw() );
+
+	// legacy used limits are drained, so they are always taken from the beginning
+	usedlimit_index usedlimits_table( _self, currency_code.raw() );
 	uint32_t i = 0;
-	do {
-		itr = usedlimits_table.erase( itr );
-		++i;
-	} while( itr != usedlimits_table.end() && i < user_count );
+	for( auto itr = usedlimits_table.begin(); itr != usedlimits_table.end() && i < max_rows; ++i ) {
+		auto account = itr->account;
+		++itr;
+		if( policies.find( account.value ) == policies.end() ) {
+			seed_policy( policies, currency_code, account, _self );
+		} else {
+			// stale row left from before the policy row was created
+			usedlimits_table.erase( usedlimits_table.find( account.value ));
+		}
+	}
+	bool complete = usedlimits_table.begin() == usedlimits_table.end();
+
+	// whitelists are paged by account name, starting at from
+	whitelist_index whitelists_table( _self, currency_code.raw() );
+	i = 0;
+	auto wl = whitelists_table.lower_bound( from.value );
+	for( ; wl != whitelists_table.end() && i < max_rows; ++wl, ++i ) {
+		if( policies.find( wl->username.value ) == policies.end() ) {
+			seed_policy( policies, currency_code, wl->username, ram_payer );
+		}
+	}
+	complete = complete && wl == whitelists_table.end();
+
+	whitelistto_index whiteliststo_table( _self, currency_code.raw() );
+	i = 0;
+	auto wlto = whiteliststo_table.lower_bound( from.value );
+	for( ; wlto != whiteliststo_table.end() && i < max_rows; ++wlto, ++i ) {
+		if( policies.find( wlto->username.value ) == policies.end() ) {
+			seed_policy( policies, currency_code, wlto->username, ram_payer );
+		}
+	}
+	complete = complete && wlto == whiteliststo_table.end();
+
+	// a pass over all rows, from the first account to the end of both lists, marks the currency synced
+	tokenlimit_index limits_table( _self, _self.value );
+	auto token_limit = limits_table.find( currency_code.raw() );
+	if( complete && from == eosio::name() && token_limit != limits_table.end() && ! token_limit->policy_synced.value_or( false ) ) {
+		limits_table.modify( token_limit, eosio::same_payer, [&](auto &c) {
+			// binary extensions are serialized in order, the earlier ones must be present
+			c.generation.emplace( c.generation.value_or( 0 ) );
+			c.mode.emplace( c.mode.value_or( calendar_month ) );
+			c.policy_synced.emplace( true );
+		});
+	}
 }
 
 [[eosio::action]] void limiter::addwhitelist(eosio::name username, eosio::symbol_code currency_code)
@@ -195,7 +736,7 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 		eosio::check( false, "missing authority either of token issuer or limiter" );
 	}
 
-	eosio::check( currency_code != _untb_symbol_code, "UNTB is not supported" );
+	eosio::check( !( symbol_flags( currency_code ) & symbol_policy::limit_exempt ), currency_code.to_string() + " is not supported" );
 
 	whitelist_index table(_self, currency_code.raw());
 	auto pos = table.find( username.value );
@@ -206,6 +747,8 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 		c.username  = username;
 		c.ts = eosio::time_point_sec(eosio::current_time_point());
 	});
+
+	set_policy_flag( currency_code, username, whitelisted, true, ram_payer );
 }
 
 [[eosio::action]] void limiter::addwhiteto(eosio::name username, eosio::symbol_code currency_code)
@@ -217,7 +760,7 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 		eosio::check( false, "missing authority either of token issuer or limiter" );
 	}
 
-	eosio::check( currency_code != _untb_symbol_code, "UNTB is not supported" );
+	eosio::check( !( symbol_flags( currency_code ) & symbol_policy::limit_exempt ), currency_code.to_string() + " is not supported" );
 
 	whitelistto_index table(_self, currency_code.raw());
 	auto pos = table.find( username.value );
@@ -228,6 +771,73 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 		c.username  = username;
 		c.ts = eosio::time_point_sec(eosio::current_time_point());
 	});
+
+	set_policy_flag( currency_code, username, whitelisted_to, true, ram_payer );
+}
+
+[[eosio::action]] void limiter::addwhitelists( eosio::symbol_code currency_code, std::vector<eosio::name> usernames )
+{
+	eosio::name ram_payer = get_issuer( currency_code );
+	if( has_auth( _self ) ) {
+		ram_payer = _self;
+	} else if( ! has_auth( ram_payer )) {
+		eosio::check( false, "missing authority either of token issuer or limiter" );
+	}
+
+	eosio::check( !( symbol_flags( currency_code ) & symbol_policy::limit_exempt ), currency_code.to_string() + " is not supported" );
+	eosio::check( usernames.size() <= max_batch_size, "too many entries" );
+
+	whitelist_index table( _self, currency_code.raw() );
+	const eosio::time_point_sec ct( eosio::current_time_point() );
+	uint32_t applied = 0;
+	for( auto username : usernames ) {
+		if( table.find( username.value ) != table.end() ) {
+			continue;
+		}
+		table.emplace( ram_payer, [&](auto &c ) {
+			c.username = username;
+			c.ts = ct;
+		});
+		set_policy_flag( currency_code, username, whitelisted, true, ram_payer );
+		++applied;
+	}
+	report_batch( "addwhitelists"_n, applied, usernames.size() - applied );
+}
+
+[[eosio::action]] void limiter::rmwhitelists( eosio::symbol_code currency_code, std::vector<eosio::name> usernames )
+{
+	eosio::check( has_auth( get_issuer( currency_code ) ) || has_auth( _self ),
+			"missing authority either of token issuer or limiter" );
+	eosio::check( usernames.size() <= max_batch_size, "too many entries" );
+
+	whitelist_index table( _self, currency_code.raw() );
+	uint32_t applied = 0;
+	for( auto username : usernames ) {
+		auto pos = table.find( username.value );
+		if( pos == table.end() ) {
+			continue;
+		}
+		table.erase( pos );
+		set_policy_flag( currency_code, username, whitelisted, false, _self );
+		++applied;
+	}
+	report_batch( "rmwhitelists"_n, applied, usernames.size() - applied );
+}
+
+// Applied/skipped counts of a batch action, sent to the limiter itself without authorization so that they
+// show up in the action trace
+void limiter::report_batch( eosio::name action, uint32_t applied, uint32_t skipped )
+{
+	eosio::action(
+		std::vector<eosio::permission_level>{},
+		_self,
+		"batchresult"_n,
+		std::make_tuple( action, applied, skipped )
+	).send();
+}
+
+[[eosio::action]] void limiter::batchresult( eosio::name action, uint32_t applied, uint32_t skipped )
+{
 }
 
 [[eosio::action]] void limiter::rmwhitelist(eosio::name username, eosio::symbol_code currency_code)
@@ -240,6 +850,8 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 
 	eosio::check( pos!=table.end(), "User not in whitelist" );
 	table.erase (pos);
+
+	set_policy_flag( currency_code, username, whitelisted, false, _self );
 }
 
 [[eosio::action]] void limiter::rmwhiteto(eosio::name username, eosio::symbol_code currency_code)
@@ -252,102 +864,113 @@ eosio::name limiter::get_issuer ( eosio::symbol_code currency_code )
 
 	eosio::check( pos!=table.end(), "User not in whitelistto" );
 	table.erase (pos);
-}
 
-bool limiter::is_current_month (uint32_t last_utc, uint32_t current_utc)
-{
-	tm last_tm;
-	if (! __secs_to_tm(last_utc ,&last_tm) ) {
-		return true;
-	}
-
-	tm current_tm;
-	if (! __secs_to_tm(current_utc,&current_tm) ) {
-		return true;
-	}
-#ifdef TEST_CONTRACT
-	//check that hour is matching
-	return (current_tm.tm_hour == last_tm.tm_hour);
-#else
-	//check that year and months are matching
-	return (current_tm.tm_year==last_tm.tm_year && current_tm.tm_mon==last_tm.tm_mon);
-#endif
+	set_policy_flag( currency_code, username, whitelisted_to, false, _self );
 }
 
-
-[[eosio::action]] void limiter::checklimit(eosio::name username, eosio::name to, eosio::asset sum, std::string memo)
-{
-#ifdef TEST_CONTRACT
-	eosio::check( has_auth( _self ) || has_auth( _eosiotoken ), "missing authority either of limiter or eosio.token" );
+// check_transfer Storage over the limiter tables, for one checklimit call
+struct limiter::table_storage {
+	limiter &self;
+	eosio::name username;
+	eosio::name to;
+	const eosio::asset &sum;
+	const std::string &memo;
+
+	debt_index debts;
+	policy_index policies;
+	policy_index::const_iterator from_row;
+	policy_state from_state;
+	eosio::asset month_limit;
+
+	table_storage( limiter &self, eosio::name username, eosio::name to, const eosio::asset &sum, const std::string &memo )
+		: self( self ), username( username ), to( to ), sum( sum ), memo( memo ),
+		  debts( _self, username.value ), policies( _self, sum.symbol.code().raw() )
+	{}
+
+	void account_state( uint64_t account, bool &is_locked, bool &has_debts ) {
+#if LIMITER_ACCOUNT_STATE
+		acctstate_index states( _self, _self.value );
+		auto state = states.find( account );
+		if( state != states.end() ) {
+			is_locked = ( state->flags & locked ) != 0;
+			has_debts = state->debt_count > 0;
+		}
 #else
-	require_auth( _eosiotoken );
+		lock_index lockstable( _self, _self.value );
+		is_locked = lockstable.find( account ) != lockstable.end();
+		has_debts = debts.begin() != debts.end();
 #endif
+	}
 
-	bool debt_return_only = false;
-
-    lock_index lockstable( _self, _self.value );
-    const auto& lock_iter = lockstable.find( username.value );
-    if (lock_iter != lockstable.end()) {
-    	debt_return_only = true;
-    }
-
-	debt_index debts( _self, username.value );
-	if( debts.begin() != debts.end() ) {
-
-		eosio::checksum256 hash = calcDebtHash ( username, to, sum, memo );
+	bool take_debt( uint64_t debtor ) {
 		auto idx = debts.template get_index<"byhash"_n>();
-		auto debt_iter = idx.find( hash );
-
-		eosio::check( debt_iter != idx.end(), "Transfer valid for debt return only" );
-
+		auto debt_iter = idx.find( self.actionDebtHash() );
+		if( debt_iter == idx.end() ) {
+			debt_iter = idx.find( self.calcDebtHash( username, to, sum, memo ) );
+		}
+		if( debt_iter == idx.end() ) {
+			return false;
+		}
+		self.update_account_state( username, -1, 0, 0, _self );
 		idx.erase( debt_iter );
-
-	} else {
-		eosio::check( ! debt_return_only, "Account is locked" );
+		return true;
 	}
 
-	eosio::symbol_code currency_code = sum.symbol.code();
-	if( currency_code == _untb_symbol_code ) {
-		// Limit for UNTB not set
-		return;
+	uint8_t symbol_flags( uint64_t code ) {
+		return self.symbol_flags( eosio::symbol_code( code ) );
 	}
 
-	tokenlimit_index limits(_self, _self.value);
-	auto token_limit = limits.find(currency_code.raw());
-	if( token_limit == limits.end() ) {
-		// Limit for the currency not set
-		return;
+	bool find_limit( uint64_t code, limit_state &limit ) {
+		tokenlimit_index limits( _self, _self.value );
+		auto token_limit = limits.find( code );
+		if( token_limit == limits.end() ) {
+			return false;
+		}
+		month_limit = token_limit->month_limit;
+		limit = limit_of( *token_limit );
+		return true;
 	}
 
-	whitelistto_index whiteliststo_table(_self, currency_code.raw());
-	if( whiteliststo_table.find( to.value ) != whiteliststo_table.end() ) {
-		// target account in white list for the currency
-		return;
+	bool whitelisted_to( uint64_t code, uint64_t account, const limit_state &limit ) {
+		auto to_policy = policies.find( account );
+		if( to_policy != policies.end() ) {
+			return ( to_policy->flags & ::whitelisted_to ) != 0;
+		}
+		if( limit.policy_synced ) {
+			// no policy row, no legacy row either
+			return false;
+		}
+		// account not synced yet
+		whitelistto_index whiteliststo_table( _self, code );
+		return whiteliststo_table.find( account ) != whiteliststo_table.end();
 	}
 
-	whitelist_index whitelists_table(_self, currency_code.raw());
-	if( whitelists_table.find( username.value ) != whitelists_table.end() ) {
-		// User in white list for the currency
-		return;
+	policy_state &from_policy( uint64_t code, uint64_t account ) {
+		from_row = policies.find( account );
+		if( from_row == policies.end() ) {
+			from_row = self.seed_policy( policies, sum.symbol.code(), eosio::name( account ), _self );
+		}
+		from_state = state_of( *from_row );
+		return from_state;
 	}
 
-	usedlimit_index usedlimits( _self, currency_code.raw() );
-	auto used_limit = usedlimits.find( username.value );
-
-	int64_t used_amount = 0;
-	bool same_month = false;
-	eosio::time_point_sec ct(eosio::current_time_point());
+	void store_policy( uint64_t code, policy_state &p ) {
+		policies.modify( from_row, eosio::same_payer, [&](auto &c) {
+			c.used_amount = p.used_amount;
+			c.period = p.period;
+			c.generation = p.generation;
+			c.ts = eosio::time_point_sec( p.ts );
+			c.window = std::move( p.window );
+		});
+	}
 
-	if( used_limit != usedlimits.end() ) {
-		same_month = is_current_month ( used_limit->ts.utc_seconds, ct.utc_seconds );
-		if( same_month ) {
-			used_amount = used_limit->used_limit.amount;
-		}
+	void fail( const char *msg ) {
+		eosio::check( false, msg );
 	}
 
-	if( used_amount + sum.amount > token_limit->month_limit.amount ) {
-		eosio::asset limit_asset = token_limit->month_limit;
-		std::string msg = "Token transfer limit exceeded, max month transfer ";
+	void limit_exceeded( const limit_state &limit, int64_t used_amount ) {
+		eosio::asset limit_asset = month_limit;
+		std::string msg = limit.mode == rolling_window ? "Token transfer limit exceeded, max transfer in 30 days " : "Token transfer limit exceeded, max month transfer ";
 		msg += limit_asset.to_string();
 		if( used_amount > 0 ) {
 			msg += ", used ";
@@ -355,29 +978,79 @@ bool limiter::is_current_month (uint32_t last_utc, uint32_t current_utc)
 			msg += limit_asset.to_string();
 
 			msg += ", possible ";
-			limit_asset.amount = token_limit->month_limit.amount - used_amount;
+			limit_asset.amount = month_limit.amount - used_amount;
 			msg += limit_asset.to_string();
 
 		}
 		eosio::check( false, msg );
 	}
+};
 
-	if( used_limit != usedlimits.end() ) {
-		usedlimits.modify( used_limit, _self, [&](auto &c) {
-			if( same_month ) {
-				c.used_limit.amount += sum.amount;
-			} else {
-				c.used_limit.amount = sum.amount;
-			}
-			c.ts = ct;
-		});
-	} else {
-		usedlimits.emplace( _self, [&](auto &c) {
-			c.account = username;
-			c.used_limit = sum;
-			c.ts = ct;
-		});
+[[eosio::action]] void limiter::checklimit(eosio::name username, eosio::name to, eosio::asset sum, std::string memo)
+{
+#ifdef TEST_CONTRACT
+	eosio::check( has_auth( _self ) || has_auth( _eosiotoken ), "missing authority either of limiter or eosio.token" );
+#else
+	require_auth( _eosiotoken );
+#endif
+
+	table_storage db( *this, username, to, sum, memo );
+	check_transfer( db, username.value, to.value, sum.symbol.code().raw(), sum.amount, eosio::current_time_point().sec_since_epoch() );
+}
+
+// Reports what checklimit would allow for transfers from account without changing any state:
+// the remaining limit of the currency, and whether the account is locked or has debts to return.
+// The lock flag and debt count come from the acctstate row, a single lookup however many debts there are.
+[[eosio::action]] void limiter::getquota( eosio::name account, eosio::symbol sym )
+{
+	bool is_locked = false;
+	uint32_t debt_count = 0;
+	acctstate_index states( _self, _self.value );
+	auto state = states.find( account.value );
+	if( state != states.end() ) {
+		is_locked = ( state->flags & locked ) != 0;
+		debt_count = state->debt_count;
+	}
+#if ! LIMITER_ACCOUNT_STATE
+	else {
+		// locked or indebted before acctstate and not synced yet: a debt_count of 1 stands for any
+		// number of debts until syncacct has counted them
+		lock_index locks( _self, _self.value );
+		is_locked = locks.find( account.value ) != locks.end();
+		debt_index debts( _self, account.value );
+		debt_count = debts.begin() != debts.end() ? 1 : 0;
+	}
+#endif
+
+	bool limited = false;
+	eosio::asset remaining( eosio::asset::max_amount, sym );
+
+	tokenlimit_index limits( _self, _self.value );
+	auto token_limit = limits.find( sym.code().raw() );
+	if( !( symbol_flags( sym.code() ) & symbol_policy::limit_exempt ) && token_limit != limits.end() ) {
+		policy_index policies( _self, sym.code().raw() );
+		auto it = policies.find( account.value );
+		const policy_state p = state_of( it != policies.end() ? *it : legacy_policy( sym.code(), account ) );
+
+		if( !( p.flags & whitelisted ) ) {
+			std::vector<int64_t> window;
+			const int64_t used_amount = current_used_amount( p, limit_of( *token_limit ), eosio::current_time_point().sec_since_epoch(), window );
+			limited = true;
+			remaining.amount = std::max( token_limit->month_limit.amount - used_amount, int64_t( 0 ) );
+		}
 	}
+
+	// no authorization, as rex.results: the action only carries the answer into the trace
+	eosio::action(
+		std::vector<eosio::permission_level>{},
+		_self,
+		"quotaresult"_n,
+		std::make_tuple( account, limited, remaining, is_locked, debt_count )
+	).send();
+}
+
+[[eosio::action]] void limiter::quotaresult( eosio::name account, bool limited, eosio::asset remaining, bool is_locked, uint32_t debt_count )
+{
 }
 
 extern "C" void apply( uint64_t receiver, uint64_t code, uint64_t action )
@@ -396,11 +1069,31 @@ extern "C" void apply( uint64_t receiver, uint64_t code, uint64_t action )
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::addwhitelist);
 		} else if (action == "addwhiteto"_n.value) {
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::addwhiteto);
+		} else if (action == "adddebts"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::adddebts);
+		} else if (action == "addlocks"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::addlocks);
+		} else if (action == "addwhitelists"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::addwhitelists);
+		} else if (action == "rmwhitelists"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::rmwhitelists);
+		} else if (action == "batchresult"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::batchresult);
 
 		} else if (action == "deldebt"_n.value) {
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::deldebt);
 		} else if (action == "rmdebt"_n.value) {
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::rmdebt);
+		} else if (action == "rehashdebt"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::rehashdebt);
+		} else if (action == "setdebtexp"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::setdebtexp);
+		} else if (action == "gcdebts"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::gcdebts);
+		} else if (action == "syncacct"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::syncacct);
+		} else if (action == "syncaccts"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::syncaccts);
 		} else if (action == "rmlimit"_n.value) {
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::rmlimit);
 		} else if (action == "rmlock"_n.value) {
@@ -413,6 +1106,16 @@ extern "C" void apply( uint64_t receiver, uint64_t code, uint64_t action )
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::rmusedlimits);
 		} else if (action == "rmusedlimit"_n.value) {
 			execute_action(eosio::name(receiver), eosio::name(code), &limiter::rmusedlimit);
+		} else if (action == "resetused"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::resetused);
+		} else if (action == "getquota"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::getquota);
+		} else if (action == "quotaresult"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::quotaresult);
+		} else if (action == "setlimitmode"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::setlimitmode);
+		} else if (action == "syncpolicy"_n.value) {
+			execute_action(eosio::name(receiver), eosio::name(code), &limiter::syncpolicy);
 		}
 	}
 };
@@ -6,7 +6,22 @@
 #include <eosio/print.hpp>
 #include <eosio/system.hpp>
 #include <eosio/crypto.hpp>
+#include <eosio/binary_extension.hpp>
+#include <eosio/action.hpp>
+#include <algorithm>
 #include <string>
+#include <vector>
+
+#include "debtkey.hpp"
+#include "transfer_check.hpp"
+
+// 1: checklimit reads the lock and debt state of the sender from its acctstate row only and opens
+// neither the lock table nor the debt scope of accounts without one; a lock or debt change of an
+// account without a row no longer scans the account's debt scope. Build with 1 once syncaccts has
+// been run for every locked account and every debt scope, see the README.
+#ifndef LIMITER_ACCOUNT_STATE
+#define LIMITER_ACCOUNT_STATE 0
+#endif
 
 class [[eosio::contract]] limiter : public eosio::contract
 {
@@ -20,21 +35,51 @@ public:
 	[[eosio::action]] void addwhitelist( eosio::name username, eosio::symbol_code currency_code );
 	[[eosio::action]] void addwhiteto( eosio::name username, eosio::symbol_code currency_code );
 
+	struct debt_entry {
+		eosio::name debtor;
+		eosio::name target;
+		eosio::asset debt;
+		std::string memo;
+
+		EOSLIB_SERIALIZE(debt_entry, (debtor)(target)(debt)(memo))
+	};
+
+	// Batched variants, at most max_batch_size entries; entries already present or absent are skipped.
+	// The applied and skipped counts are reported with an inline batchresult action.
+	[[eosio::action]] void adddebts( std::vector<debt_entry> entries );
+	[[eosio::action]] void addlocks( std::vector<eosio::name> accounts, std::string note );
+	[[eosio::action]] void addwhitelists( eosio::symbol_code currency_code, std::vector<eosio::name> usernames );
+	[[eosio::action]] void rmwhitelists( eosio::symbol_code currency_code, std::vector<eosio::name> usernames );
+	[[eosio::action]] void batchresult( eosio::name action, uint32_t applied, uint32_t skipped );
+
 	[[eosio::action]] void deldebt( eosio::name debtor, eosio::name target, eosio::asset debt, std::string memo );
 	[[eosio::action]] void rmdebt( eosio::name debtor, uint64_t debt_id);
+	[[eosio::action]] void rehashdebt( eosio::name debtor, uint32_t max_rows, eosio::binary_extension<uint64_t> from_id );
+	[[eosio::action]] void syncacct( eosio::name account );
+	[[eosio::action]] void syncaccts( std::vector<eosio::name> accounts );
+	[[eosio::action]] void setdebtexp( eosio::name debtor, uint64_t debt_id, eosio::time_point_sec expires_at );
+	[[eosio::action]] void gcdebts( uint32_t max_rows );
 	[[eosio::action]] void rmlimit( eosio::symbol_code currency_code );
 	[[eosio::action]] void rmlock( eosio::name account);
 	[[eosio::action]] void rmwhitelist( eosio::name username, eosio::symbol_code currency_code );
 	[[eosio::action]] void rmwhiteto( eosio::name username, eosio::symbol_code currency_code );
 
 	[[eosio::action]] void rmusedlimit( eosio::symbol_code currency_code, eosio::name user );
-	[[eosio::action]] void rmusedlimits( eosio::symbol_code currency_code, uint32_t user_count );
+	// Clears used amounts, visiting at most user_count rows; policy rows are paged by account name starting at from
+	[[eosio::action]] void rmusedlimits( eosio::symbol_code currency_code, uint32_t user_count, eosio::binary_extension<eosio::name> from );
+	[[eosio::action]] void resetused( eosio::symbol_code currency_code );
+	[[eosio::action]] void setlimitmode( eosio::symbol_code currency_code, uint8_t mode );
+	[[eosio::action]] void syncpolicy( eosio::symbol_code currency_code, eosio::name from, uint32_t max_rows );
 	[[eosio::action]] void checklimit( eosio::name username, eosio::name to, eosio::asset sum, std::string memo );
 
+	// Read-only, the answer is sent as an inline quotaresult action; remaining is max_amount when not limited
+	[[eosio::action]] void getquota( eosio::name account, eosio::symbol sym );
+	[[eosio::action]] void quotaresult( eosio::name account, bool limited, eosio::asset remaining, bool is_locked, uint32_t debt_count );
+
 	static constexpr eosio::name _self = "limiter"_n;
-	static constexpr eosio::symbol_code _untb_symbol_code = eosio::symbol_code("UNTB");
 	static constexpr eosio::name _eosiotoken = "eosio.token"_n;
 	static constexpr eosio::name _debtadmin = "debtadmin"_n;
+	static constexpr uint32_t max_batch_size = 200;
 
 	struct [[eosio::table]] currency_stats {
 		eosio::asset supply;
@@ -46,77 +91,75 @@ public:
 		}
 	};
 
-    struct [[eosio::table]] lock {
-		eosio::name account;
-		eosio::time_point_sec ts;
-		std::string note;
+	// rows eosio.token reads as well: lock, debt, tokenlimit, whitelist, whitelistto, policy
+#define LIMITER_TABLE [[eosio::table]]
+#include <eosio.token/limiter_tables.hpp>
+#undef LIMITER_TABLE
 
-		uint64_t primary_key() const {
-			return account.value;
-		}
-		EOSLIB_SERIALIZE(lock, (account)(ts)(note))
-	};
-
-	struct [[eosio::table]] debt {
+	// Expiry queue of debts across debtors, scope _self. A debt row only counts as expired while its
+	// expires_at equals the queue entry, entries of debts removed or re-dated in between are dropped.
+	struct [[eosio::table]] debtexpiry {
 		uint64_t id;
-		eosio::name target;
-		eosio::asset sum;
-		eosio::time_point_sec ts;
-		std::string memo;
-		eosio::checksum256 hash;
+		eosio::name debtor;
+		uint64_t debt_id;
+		eosio::time_point_sec expires_at;
 
 		uint64_t primary_key() const {
 			return id;
 		}
-		eosio::checksum256 byhash() const {
-			return hash;
+		uint64_t byexpiry() const {
+			return expires_at.utc_seconds;
 		}
-		EOSLIB_SERIALIZE(debt, (id)(target)(sum)(ts)(memo)(hash))
+		uint128_t bydebt() const {
+			return uint128_t( debtor.value ) << 64 | debt_id;
+		}
+		EOSLIB_SERIALIZE(debtexpiry, (id)(debtor)(debt_id)(expires_at))
 	};
 
-	struct [[eosio::table]] tokenlimit {
-		eosio::asset month_limit;
+	// tokenlimit mode values are limit_mode of limiter_check.hpp
+
+	struct [[eosio::table]] usedlimit {
+		eosio::name account;
+		eosio::asset used_limit;
 		eosio::time_point_sec ts;
 
 		uint64_t primary_key() const {
-			return month_limit.symbol.code().raw();
+			return account.value;
 		}
-		EOSLIB_SERIALIZE(tokenlimit, (month_limit)(ts))
+		EOSLIB_SERIALIZE(usedlimit, (account)(used_limit)(ts))
 	};
 
-	struct [[eosio::table]] whitelist {
-		eosio::name username;
-		eosio::time_point_sec ts;
-
-		uint64_t primary_key() const {
-			return username.value;
-		}
-		EOSLIB_SERIALIZE(whitelist, (username)(ts))
+	enum account_flags : uint8_t {
+		locked = 1
 	};
 
-	struct [[eosio::table]] usedlimit {
+	// Lock flag and outstanding debt count of an account, scope _self.
+	// Only accounts with a lock or a debt have a row.
+	struct [[eosio::table]] acctstate {
 		eosio::name account;
-		eosio::asset used_limit;
-		eosio::time_point_sec ts;
+		uint8_t flags = 0;
+		uint32_t debt_count = 0;
 
 		uint64_t primary_key() const {
 			return account.value;
 		}
-		EOSLIB_SERIALIZE(usedlimit, (account)(used_limit)(ts))
+		EOSLIB_SERIALIZE(acctstate, (account)(flags)(debt_count))
 	};
 
-	struct [[eosio::table]] whitelistto {
-		eosio::name username;
-		eosio::time_point_sec ts;
+	// eosio.token symrule, see symbol_policy.hpp
+	struct token_symrule {
+		eosio::symbol_code code;
+		uint8_t set_flags = 0;
+		uint8_t clear_flags = 0;
 
 		uint64_t primary_key() const {
-			return username.value;
+			return code.raw();
 		}
-		EOSLIB_SERIALIZE(whitelistto, (username)(ts))
+		EOSLIB_SERIALIZE(token_symrule, (code)(set_flags)(clear_flags))
 	};
 
-
 	typedef eosio::multi_index< "stat"_n, currency_stats > stats;
+	typedef eosio::multi_index< "symrule"_n, token_symrule > token_symrules;
 	typedef eosio::multi_index< "lock"_n, lock > lock_index;
 	typedef eosio::multi_index< "debt"_n, debt
 			,eosio::indexed_by<"byhash"_n, eosio::const_mem_fun<debt, eosio::checksum256, &debt::byhash>>
@@ -125,10 +168,38 @@ public:
 	typedef eosio::multi_index< "whitelist"_n, whitelist > whitelist_index;
 	typedef eosio::multi_index< "usedlimit"_n, usedlimit > usedlimit_index;
 	typedef eosio::multi_index< "whitelistto"_n, whitelistto > whitelistto_index;
+	typedef eosio::multi_index< "policy"_n, policy > policy_index;
+	typedef eosio::multi_index< "acctstate"_n, acctstate > acctstate_index;
+	typedef eosio::multi_index< "debtexpiry"_n, debtexpiry
+			,eosio::indexed_by<"byexpiry"_n, eosio::const_mem_fun<debtexpiry, uint64_t, &debtexpiry::byexpiry>>
+			,eosio::indexed_by<"bydebt"_n, eosio::const_mem_fun<debtexpiry, uint128_t, &debtexpiry::bydebt>>
+	> debtexpiry_index;
 
 
 private:
+	// symbol_flags of the last symbol code asked for in this action
+	uint64_t _flags_cache_code = 0;
+	uint8_t _flags_cache = 0;
+
 	eosio::name get_issuer (eosio::symbol_code currency_code);
-	bool is_current_month (uint32_t last_utc, uint32_t current_utc);
+	uint8_t symbol_flags( eosio::symbol_code currency_code );
+	uint32_t limit_generation( eosio::symbol_code currency_code );
+	struct table_storage;
+	static limit_state limit_of( const tokenlimit &limit );
+	static policy_state state_of( const policy &p );
 	eosio::checksum256 calcDebtHash( eosio::name debtor, eosio::name target, eosio::asset debt, std::string memo );
+	eosio::checksum256 calcDebtHashV2( eosio::name debtor, eosio::name target, const eosio::asset &debt, const std::string &memo );
+	eosio::checksum256 actionDebtHash();
+	bool add_debt_row( eosio::name debtor, eosio::name target, const eosio::asset &debt, const std::string &memo,
+			const eosio::checksum256 &hash, eosio::name ram_payer );
+	void report_batch( eosio::name action, uint32_t applied, uint32_t skipped );
+	policy legacy_policy( eosio::symbol_code currency_code, eosio::name account );
+	policy_index::const_iterator seed_policy( policy_index &policies, eosio::symbol_code currency_code, eosio::name account, eosio::name ram_payer );
+	void set_policy_flag( eosio::symbol_code currency_code, eosio::name account, uint8_t flag, bool value, eosio::name ram_payer );
+	bool clear_used_amount( policy_index &policies, policy_index::const_iterator it );
+	uint32_t count_debts( eosio::name debtor );
+	void scan_account_state( eosio::name account, uint8_t &flags, uint32_t &debt_count );
+	void store_account_state( acctstate_index &states, acctstate_index::const_iterator it, eosio::name account,
+			uint8_t flags, uint32_t debt_count, eosio::name ram_payer );
+	void update_account_state( eosio::name account, int32_t debt_delta, uint8_t set_flags, uint8_t clear_flags, eosio::name ram_payer );
 };
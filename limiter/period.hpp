@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Calendar month of a unix time as months since January 1970, proleptic Gregorian calendar.
+// Same result as year * 12 + month of __secs_to_tm, without the cycle loops.
+// civil_from_days after H. Hinnant, shifted to March-based years so the leap day is last.
+constexpr uint32_t month_index( uint32_t utc_secs )
+{
+	const int64_t z = int64_t( utc_secs / 86400 ) + 719468;	// days since 0000-03-01
+	const int64_t era = z / 146097;
+	const int64_t doe = z - era * 146097;					// [0, 146096]
+	const int64_t yoe = ( doe - doe / 1460 + doe / 36524 - doe / 146096 ) / 365;	// [0, 399]
+	const int64_t doy = doe - ( 365 * yoe + yoe / 4 - yoe / 100 );	// [0, 365]
+	const int64_t mp = ( 5 * doy + 2 ) / 153;				// [0, 11], 0 is March
+	const int64_t month = mp + 2 - 12 * ( mp >= 10 );		// [0, 11], 0 is January
+	const int64_t year = yoe + era * 400 + ( mp >= 10 );
+
+	return uint32_t( ( year - 1970 ) * 12 + month );
+}
+
+constexpr uint32_t hour_index( uint32_t utc_secs )
+{
+	return utc_secs / 3600;
+}
+
+static_assert( month_index( 0 ) == 0, "1970-01" );
+static_assert( month_index( 951782399 ) == 30 * 12 + 1, "2000-02-28 23:59:59" );
+static_assert( month_index( 951868799 ) == 30 * 12 + 1, "2000-02-29 23:59:59" );
+static_assert( month_index( 951868800 ) == 30 * 12 + 2, "2000-03-01" );
+static_assert( month_index( 4102444800u ) == 130 * 12, "2100-01-01" );
+
+constexpr uint32_t day_index( uint32_t utc_secs )
+{
+	return utc_secs / 86400;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include <eosio.token/limiter_check.hpp>
+#include <eosio.token/symbol_policy.hpp>
+
+#include "period.hpp"
+#include "window.hpp"
+
+// Decision logic of limiter::checklimit, independent of eosiolib. The contract runs it over the limiter
+// tables (limiter::table_storage), bench/transfer_bench over an in-memory stand-in.
+//
+// Storage provides, for the transfer being checked:
+//   uint8_t symbol_flags( uint64_t code )               symbol_policy flags, overrides applied
+//   void account_state( uint64_t account, bool &is_locked, bool &has_debts )
+//   bool take_debt( uint64_t debtor )                   erase the debt the transfer returns, false if none matches
+//   bool find_limit( uint64_t code, limit_state &limit ) false if the currency has no limit
+//   bool whitelisted_to( uint64_t code, uint64_t account, const limit_state &limit )
+//   policy_state &from_policy( uint64_t code, uint64_t account )   loads the policy row, seeding it if missing
+//   void store_policy( uint64_t code, policy_state &p )  writes back the row returned by from_policy
+//   void fail( const char *msg )                         abort the transfer
+//   void limit_exceeded( const limit_state &limit, int64_t used_amount )   abort with the limit message
+
+// policy_flags, limit_mode and limit_state are in limiter_check.hpp of eosio.token, shared with its
+// in-process check.
+
+// limiter::policy without the account
+struct policy_state {
+	uint8_t flags = 0;
+	int64_t used_amount = 0;
+	uint32_t period = 0;
+	uint32_t generation = 0;
+	uint32_t ts = 0;
+	std::vector<int64_t> window;
+};
+
+constexpr uint32_t current_period( uint32_t utc_secs )
+{
+#ifdef TEST_CONTRACT
+	return hour_index( utc_secs );
+#else
+	return month_index( utc_secs );
+#endif
+}
+
+constexpr uint32_t current_bucket( uint32_t utc_secs )
+{
+#ifdef TEST_CONTRACT
+	return hour_index( utc_secs );
+#else
+	return day_index( utc_secs );
+#endif
+}
+
+// policy_state::period of a row updated at utc_secs
+constexpr uint32_t limit_period( const limit_state &limit, uint32_t utc_secs )
+{
+	return limit.mode == rolling_window ? current_bucket( utc_secs ) : current_period( utc_secs );
+}
+
+// Amount used within the current period of a limit at utc_secs. In rolling_window mode window receives
+// the ring of the row moved forward to the current bucket, for the caller to add the transfer and store.
+inline int64_t current_used_amount( const policy_state &p, const limit_state &limit, uint32_t utc_secs, std::vector<int64_t> &window )
+{
+	if( limit.mode == rolling_window ) {
+		if( p.generation != limit.generation || p.window.size() != rolling_window_buckets ) {
+			window.assign( rolling_window_buckets, 0 );
+			return 0;
+		}
+		int64_t used_amount = p.used_amount;
+		uint32_t newest = p.period;
+		window = p.window;
+		advance_window( window.data(), used_amount, newest, current_bucket( utc_secs ) );
+		return used_amount;
+	}
+	if( p.period == current_period( utc_secs ) && p.generation == limit.generation ) {
+		return p.used_amount;
+	}
+	return 0;
+}
+
+template<typename Storage>
+void check_transfer( Storage &db, uint64_t from, uint64_t to, uint64_t code, int64_t amount, uint32_t utc_secs )
+{
+	bool is_locked = false;
+	bool has_debts = false;
+	db.account_state( from, is_locked, has_debts );
+
+	if( has_debts ) {
+		if( ! db.take_debt( from ) ) {
+			db.fail( "Transfer valid for debt return only" );
+			return;
+		}
+	} else if( is_locked ) {
+		db.fail( "Account is locked" );
+		return;
+	}
+
+	if( db.symbol_flags( code ) & symbol_policy::limit_exempt ) {
+		// UNTB, never limited
+		return;
+	}
+
+	limit_state limit;
+	if( ! db.find_limit( code, limit ) ) {
+		// Limit for the currency not set
+		return;
+	}
+
+	if( db.whitelisted_to( code, to, limit ) ) {
+		// target account in white list for the currency
+		return;
+	}
+
+	policy_state &p = db.from_policy( code, from );
+	if( p.flags & whitelisted ) {
+		// User in white list for the currency
+		return;
+	}
+
+	// rolling_window: the ring is copied out, moved forward to the current bucket and written back
+	std::vector<int64_t> window;
+	int64_t used_amount = current_used_amount( p, limit, utc_secs, window );
+
+	if( used_amount + amount > limit.limit ) {
+		db.limit_exceeded( limit, used_amount );
+		return;
+	}
+
+	if( limit.mode == rolling_window ) {
+		add_to_window( window.data(), used_amount, current_bucket( utc_secs ), amount );
+	} else {
+		used_amount += amount;
+	}
+
+	p.used_amount = used_amount;
+	p.period = limit_period( limit, utc_secs );
+	p.generation = limit.generation;
+	p.ts = utc_secs;
+	p.window = std::move( window );
+	db.store_policy( code, p );
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// Rolling transfer window of rolling_window_buckets buckets (days), stored as a ring: bucket b is kept
+// at b % rolling_window_buckets and total is the sum of the buckets inside the window.
+constexpr uint32_t rolling_window_buckets = 30;
+
+// Moves a window whose newest bucket is newest forward to end at bucket, zeroing and subtracting the
+// buckets that fell out of it. Takes at most rolling_window_buckets steps however long the window
+// was idle; a bucket older than newest leaves the window as it is.
+inline void advance_window( int64_t *buckets, int64_t &total, uint32_t &newest, uint32_t bucket )
+{
+	if( bucket <= newest ) {
+		return;
+	}
+	if( bucket - newest >= rolling_window_buckets ) {
+		for( uint32_t i = 0; i < rolling_window_buckets; ++i ) {
+			buckets[i] = 0;
+		}
+		total = 0;
+	} else {
+		for( uint32_t b = newest + 1; b <= bucket; ++b ) {
+			total -= buckets[b % rolling_window_buckets];
+			buckets[b % rolling_window_buckets] = 0;
+		}
+	}
+	newest = bucket;
+}
+
+// Adds amount to the newest bucket, the window must have been advanced to it
+inline void add_to_window( int64_t *buckets, int64_t &total, uint32_t newest, int64_t amount )
+{
+	buckets[newest % rolling_window_buckets] += amount;
+	total += amount;
+}